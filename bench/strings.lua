@@ -0,0 +1,56 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+-- Measures throughput of complement, toAtgcn and
+-- toAtgcnAndGap with each supported string kernels.
+-- Usage: lua bench/strings.lua [genome.fasta] [repeats]
+-- Without fasta file, random text of 10 Mb is used.
+
+local func = require 'npge.cpp'.func
+
+local function readFasta(fname)
+    local lines = {}
+    for line in io.lines(fname) do
+        if line:sub(1, 1) ~= '>' then
+            table.insert(lines, line)
+        end
+    end
+    return table.concat(lines)
+end
+
+local function randomText(length)
+    local letters = {"A", "T", "G", "C"}
+    local t = {}
+    for i = 1, length do
+        t[i] = letters[math.random(1, 4)]
+    end
+    return table.concat(t)
+end
+
+local text
+if arg[1] then
+    text = readFasta(arg[1])
+else
+    text = randomText(10 * 1000 * 1000)
+end
+local repeats = tonumber(arg[2]) or 10
+
+local functions = {"complement", "toAtgcn", "toAtgcnAndGap"}
+
+local orig_kernels, supported = func.stringKernels()
+for _, name in ipairs(supported) do
+    func.setStringKernels(name)
+    for _, f_name in ipairs(functions) do
+        local f = func[f_name]
+        local t1 = os.clock()
+        for _ = 1, repeats do
+            f(text)
+        end
+        local t2 = os.clock()
+        local gbps = #text * repeats / (t2 - t1) / 1e9
+        print(("%-8s %-14s %.2f GB/s"):format(name, f_name,
+            gbps))
+    end
+end
+func.setStringKernels(orig_kernels)
@@ -1683,4 +1683,107 @@ AGCGCTCCACGTCGATAGGGTGGGAGAGGGAGAAAA
         assert.truthy(text:match(
             'ATGCATGCATGCATGCATGCATGCATGCATGCATGC'))
     end)
+
+    local function blastOutputs()
+        local m = require 'npge.model'
+        local complement = require 'npge.alignment.complement'
+        local s1 = m.Sequence('s1', 'ACGTTGCAAGGCTTAACCGA')
+        local s2 = m.Sequence('s2', 'ACGTTGCTAGGCTTACCGA')
+        local s3 = m.Sequence('s3',
+            complement('ACGTTGCTAGGCTTACCGA'))
+        local pairwise = [[
+Query= s1
+
+Length=20
+> s2
+Length=19
+
+ Score = 30.1 bits (32),  Expect = 1e-05
+ Identities = 18/20 (90%), Gaps = 1/20 (5%)
+ Strand=Plus/Plus
+
+Query  1   ACGTTGCAAG  10
+           ||||||| ||
+Sbjct  1   ACGTTGCTAG  10
+
+Query  11  GCTTAACCGA  20
+           ||||| ||||
+Sbjct  11  GCTTA-CCGA  19
+
+> s3
+Length=19
+
+ Score = 30.1 bits (32),  Expect = 1e-05
+ Identities = 18/20 (90%), Gaps = 1/20 (5%)
+ Strand=Plus/Minus
+
+Query  1   ACGTTGCAAGGCTTAACCGA  20
+           ||||||| ||||||| ||||
+Sbjct  19  ACGTTGCTAGGCTTA-CCGA  1
+]]
+        local tabular = table.concat({
+            '# BLASTN 2.2.31+',
+            '# Query: s1',
+            '# 2 hits found',
+            's1\ts2 ac=1\t1\t20\t1\t19\t7AT7A-4',
+            's1\ts3\t1\t20\t19\t1\t7AT7A-4',
+            '# BLAST processed 1 queries',
+        }, '\n')
+        return {s1, s2, s3}, pairwise, tabular
+    end
+
+    it("reads pairwise and tabular output (#read_blast)",
+    function()
+        local m = require 'npge.model'
+        local ReadBlast = require 'npge.cpp'.algo.ReadBlast
+        local seqs, pairwise, tabular = blastOutputs()
+        local query = m.BlockSet({seqs[1]}, {})
+        local bank = m.BlockSet({seqs[2], seqs[3]}, {})
+        local hits = ReadBlast(pairwise, query, bank, false)
+        assert.equal(hits, ReadBlast(tabular,
+            query, bank, false))
+        assert.equal(#hits:sequences(), 3)
+        assert.equal(hits:size(), 2)
+        local f2 = m.Fragment(seqs[2], 0, 18, 1)
+        local f3 = m.Fragment(seqs[3], 18, 0, -1)
+        for _, f in ipairs({f2, f3}) do
+            local block = hits:blockByFragment(f)
+            assert.truthy(block)
+            assert.equal(block:text(f),
+                'ACGTTGCTAGGCTTA-CCGA')
+        end
+        -- read from file
+        local tmpName = require 'npge.util.tmpName'
+        local fname = tmpName()
+        local file = io.open(fname, 'w')
+        file:write(tabular)
+        file:close()
+        file = io.open(fname)
+        assert.equal(hits, ReadBlast(file, query, bank, false))
+        file:close()
+        os.remove(fname)
+        -- query is bank
+        local bs = m.BlockSet(seqs, {})
+        local same_hits = ReadBlast(tabular, bs, bs, true)
+        assert.equal(same_hits:size(), 2)
+    end)
+
+    it("throws on bad output of blastn (#read_blast)",
+    function()
+        local m = require 'npge.model'
+        local ReadBlast = require 'npge.cpp'.algo.ReadBlast
+        local seqs = blastOutputs()
+        local bs = m.BlockSet(seqs, {})
+        assert.has_error(function()
+            ReadBlast('', bs, bs, false)
+        end)
+        assert.has_error(function()
+            ReadBlast('s1\ts2\t1\t20\t1\t19\t7AT7A-5',
+                bs, bs, false)
+        end)
+        assert.has_error(function()
+            ReadBlast('s1\ts4\t1\t20\t1\t19\t7AT7A-4',
+                bs, bs, false)
+        end)
+    end)
 end)
@@ -102,4 +102,58 @@ describe("npge.algo.BlocksWithoutOverlaps", function()
         local BWO = require 'npge.algo.BlocksWithoutOverlaps'
         assert.equal(BWO(orig, added), BS({s}, {b2}))
     end)
+
+    it("merges blocksets without overlaps (many blocks)",
+    function()
+        local model = require 'npge.model'
+        local S = model.Sequence
+        local F = model.Fragment
+        local B = model.Block
+        local BS = model.BlockSet
+        local s1 = S("g1&c&c", string.rep('A', 300))
+        local s2 = S("g2&c&c", string.rep('A', 300))
+        local function makeBlocks(seed)
+            local blocks = {}
+            for i = 1, 50 do
+                local x = (i * seed) % 290
+                local y = (i * seed * 7) % 290
+                local length = (i * seed) % 9 + 1
+                table.insert(blocks, B({
+                    F(s1, x, x + length - 1, 1),
+                    F(s2, y + length - 1, y, -1),
+                }))
+            end
+            return blocks
+        end
+        local orig = BS({s1, s2}, makeBlocks(13))
+        local added = BS({s1, s2}, makeBlocks(31))
+        local BWO = require 'npge.algo.BlocksWithoutOverlaps'
+        local result = BWO(orig, added)
+        assert.truthy(result:size() > 0)
+        -- no overlaps in result
+        for block in result:iterBlocks() do
+            for f in block:iterFragments() do
+                assert.same({f}, result:overlappingFragments(f))
+            end
+        end
+        -- each block is either selected or overlaps
+        local better = require 'npge.block.better'
+        for _, bs in ipairs({orig, added}) do
+            for block in bs:iterBlocks() do
+                if not result:hasBlock(block) then
+                    local found = false
+                    for f in block:iterFragments() do
+                        for _, f1 in ipairs(
+                                result:overlappingFragments(f)) do
+                            local block1 = result:blockByFragment(f1)
+                            if not better(block, block1) then
+                                found = true
+                            end
+                        end
+                    end
+                    assert.truthy(found)
+                end
+            end
+        end
+    end)
 end)
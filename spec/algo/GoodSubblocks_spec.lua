@@ -2,6 +2,81 @@
 -- Copyright (C) 2014-2016 Boris Nagaev
 -- See the LICENSE file for terms of use.
 
+-- reference implementation in Lua, npge.block.goodSubblocks
+-- was ported from it to C++
+local function removeMostDistant(block)
+    local consensus = require 'npge.block.consensus'
+    local identity = require 'npge.alignment.identity'
+    local c = consensus(block)
+    local worst_ident, worst_fragment
+    for fragment in block:iterFragments() do
+        local row = block:text(fragment)
+        local ident = identity({c, row})
+        if not worst_ident or ident < worst_ident then
+            worst_ident = ident
+            worst_fragment = fragment
+        end
+    end
+    assert(worst_fragment)
+    local for_block = {}
+    for fragment in block:iterFragments() do
+        if fragment ~= worst_fragment then
+            local row = block:text(fragment)
+            table.insert(for_block, {fragment, row})
+        end
+    end
+    assert(#for_block == block:size() - 1)
+    local refine = require 'npge.block.refine'
+    local Block = require 'npge.model.Block'
+    return refine(Block(for_block))
+end
+
+local function luaGoodSubblocks(block)
+    -- try to find subblocks of same size as original block
+    local config = require 'npge.config'
+    local min_length = config.general.MIN_LENGTH
+    local min_identity = config.general.MIN_IDENTITY
+    local min_end = config.general.MIN_END
+    local frame_length = config.general.FRAME_LENGTH
+    if block:length() < min_length then
+        -- block is too short
+        return {}
+    end
+    -- block of 1 fragments: nothing to do
+    if block:size() < 2 then
+        return {}
+    end
+    -- make rows
+    local rows = {}
+    for fragment in block:iterFragments() do
+        table.insert(rows, block:text(fragment))
+    end
+    -- find continous groups of identical columns
+    local goodColumns = require 'npge.alignment.goodColumns'
+    local goodSlices = require 'npge.alignment.goodSlices'
+    local slice = require 'npge.block.slice'
+    local good_col = goodColumns(rows,
+            min_identity, min_length)
+    local good_slices = goodSlices(good_col,
+            frame_length, min_end,
+            min_identity, min_length)
+    if #good_slices > 0 then
+        local result = {}
+        for _, s in ipairs(good_slices) do
+            local subblock = slice(block, s[1], s[2])
+            table.insert(result, subblock)
+        end
+        return result
+    end
+    -- block of 2 fragments: nothing to do
+    if block:size() <= 2 then
+        return {}
+    end
+    -- try to remove the most distant fragment
+    local block1 = removeMostDistant(block)
+    return luaGoodSubblocks(block1)
+end
+
 describe("npge.algo.GoodSubblocks", function()
     it("extracts good parts of blocks (already good)",
     function()
@@ -53,6 +128,34 @@ describe("npge.algo.GoodSubblocks", function()
         assert.truthy(isGood(good_blocks:blocks()[1]))
     end)
 
+    it("gives same result for any number of workers (#workers)",
+    function()
+        local npge = require 'npge'
+        local config = require 'npge.config'
+        local bs = dofile 'spec/sample_pangenome.lua'
+        local function goodSubblocks(workers)
+            local revert = config:updateKeys({
+                general = {MIN_IDENTITY = 0.9},
+                util = {WORKERS = workers},
+            })
+            local result = npge.algo.GoodSubblocks(bs)
+            -- compare with the implementation in Lua
+            local blocks = {}
+            for block in bs:iterBlocks() do
+                local gs = luaGoodSubblocks(block)
+                for _, subblock in ipairs(gs) do
+                    table.insert(blocks, subblock)
+                end
+            end
+            local expected = npge.model.BlockSet(
+                bs:sequences(), blocks)
+            revert()
+            assert.equal(result, expected)
+            return result
+        end
+        assert.equal(goodSubblocks(1), goodSubblocks(4))
+    end)
+
     it("no crash on many passes of GoodSubblocks (threads)",
     function()
         -- too slow
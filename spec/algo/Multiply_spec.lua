@@ -116,6 +116,81 @@ describe("npge.algo.Multiply", function()
         )
     end)
 
+    it("preserves #alignment of first blockset", function()
+        local model = require 'npge.model'
+        local s1 = model.Sequence("g1&c&c", "ATGC")
+        local s2 = model.Sequence("g2&c&c", "AGC")
+        local f1 = model.Fragment(s1, 0, 3, 1)
+        local f2 = model.Fragment(s2, 0, 2, 1)
+        local bs1 = model.BlockSet({s1, s2}, {
+            model.Block({{f1, "ATGC"}, {f2, "A-GC"}}),
+        })
+        local bs2 = model.BlockSet({s1, s2}, {
+            model.Block({
+                model.Fragment(s1, 0, 1, 1),
+                model.Fragment(s2, 0, 0, 1),
+            }),
+            model.Block({
+                model.Fragment(s1, 2, 3, 1),
+                model.Fragment(s2, 1, 2, 1),
+            }),
+        })
+        local Multiply = require 'npge.algo.Multiply'
+        assert.equal(
+            Multiply(bs1, bs2),
+            model.BlockSet({s1, s2}, {
+                model.Block({
+                    {model.Fragment(s1, 0, 1, 1), "AT"},
+                    {model.Fragment(s2, 0, 0, 1), "A-"},
+                }),
+                model.Block({
+                    {model.Fragment(s1, 2, 3, 1), "GC"},
+                    {model.Fragment(s2, 1, 2, 1), "GC"},
+                }),
+            })
+        )
+        -- gap-only columns are removed
+        local bs3 = model.BlockSet({s1, s2}, {
+            model.Block({
+                model.Fragment(s1, 0, 1, 1),
+            }),
+            model.Block({
+                model.Fragment(s1, 2, 3, 1),
+                model.Fragment(s2, 0, 2, 1),
+            }),
+        })
+        assert.equal(
+            Multiply(bs1, bs3),
+            model.BlockSet({s1, s2}, {
+                model.Block({
+                    {model.Fragment(s1, 0, 1, 1), "AT"},
+                }),
+                model.Block({
+                    {model.Fragment(s1, 2, 3, 1), "-GC"},
+                    {model.Fragment(s2, 0, 2, 1), "AGC"},
+                }),
+            })
+        )
+    end)
+
+    it("joins parts of #parted fragments", function()
+        local model = require 'npge.model'
+        local s1 = model.Sequence("g1&c&c", "ATGCAT")
+        local bs1 = model.BlockSet({s1}, {
+            model.Block({
+                model.Fragment(s1, 4, 1, 1),
+                model.Fragment(s1, 3, 2, -1),
+            }),
+        })
+        local bs2 = model.BlockSet({s1}, {
+            model.Block({
+                model.Fragment(s1, 0, 5, 1),
+            }),
+        })
+        local Multiply = require 'npge.algo.Multiply'
+        assert.equal(Multiply(bs1, bs2), bs1)
+    end)
+
     it("throws if a blockset is not a partition", function()
         local model = require 'npge.model'
         local s1 = model.Sequence("g1&c&c", "ATGC")
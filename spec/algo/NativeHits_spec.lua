@@ -0,0 +1,168 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+describe("npge.algo.NativeHits", function()
+    local function randomText(length)
+        local letters = 'ATGC'
+        local t = {}
+        for i = 1, length do
+            local index = math.random(1, #letters)
+            t[i] = letters:sub(index, index)
+        end
+        return table.concat(t)
+    end
+
+    -- replaces each 50th letter and removes each 170th
+    local function mutate(text)
+        local t = {}
+        for i = 1, #text do
+            local c = text:sub(i, i)
+            if i % 50 == 0 then
+                c = (c == 'A') and 'C' or 'A'
+            end
+            if i % 170 ~= 0 then
+                table.insert(t, c)
+            end
+        end
+        return table.concat(t)
+    end
+
+    local function checkHit(block)
+        assert.equal(block:size(), 2)
+        for fragment in block:iterFragments() do
+            local text = block:text(fragment)
+            local ungapped = text:gsub('-', '')
+            assert.equal(ungapped, fragment:text())
+        end
+    end
+
+    it("finds hits of identical sequences", function()
+        local npge = require 'npge'
+        local text = randomText(1000)
+        local s1 = npge.model.Sequence('s1', text)
+        local s2 = npge.model.Sequence('s2', text)
+        local hits = npge.algo.NativeHits(
+            npge.model.BlockSet({s1}, {}),
+            npge.model.BlockSet({s2}, {}))
+        assert.equal(#hits:sequences(), 2)
+        assert.equal(#hits:blocks(), 1)
+        local block = hits:blocks()[1]
+        checkHit(block)
+        assert.equal(block:length(), 1000)
+        assert.truthy(block:fragments()[1]:ori() == 1)
+        assert.truthy(block:fragments()[2]:ori() == 1)
+    end)
+
+    it("finds hits on reverse strand", function()
+        local npge = require 'npge'
+        local complement = npge.alignment.complement
+        local text = randomText(1000)
+        local s1 = npge.model.Sequence('s1', text)
+        local s2 = npge.model.Sequence('s2',
+            randomText(100) .. complement(text))
+        local hits = npge.algo.NativeHits(
+            npge.model.BlockSet({s1}, {}),
+            npge.model.BlockSet({s2}, {}))
+        assert.equal(#hits:blocks(), 1)
+        local block = hits:blocks()[1]
+        checkHit(block)
+        assert.equal(block:length(), 1000)
+        local f = block:fragments()[2]
+        if f:sequence() ~= s2 then
+            f = block:fragments()[1]
+        end
+        assert.equal(f:ori(), -1)
+        assert.equal(f:start(), 1099)
+        assert.equal(f:stop(), 100)
+    end)
+
+    it("aligns sequences with mismatches and gaps", function()
+        local npge = require 'npge'
+        local text = randomText(2000)
+        local s1 = npge.model.Sequence('s1', text)
+        local s2 = npge.model.Sequence('s2', mutate(text))
+        local hits = npge.algo.NativeHits(
+            npge.model.BlockSet({s1}, {}),
+            npge.model.BlockSet({s2}, {}))
+        assert.equal(#hits:blocks(), 1)
+        local block = hits:blocks()[1]
+        checkHit(block)
+        assert.truthy(block:length() >= 1990)
+        local identity = npge.block.identity(block)
+        assert.truthy(identity > 0.95)
+    end)
+
+    it("finds each hit once if query is bank (#same)",
+    function()
+        local npge = require 'npge'
+        local text = randomText(1000)
+        local s1 = npge.model.Sequence('s1', text)
+        local s2 = npge.model.Sequence('s2', text)
+        local s3 = npge.model.Sequence('s3', randomText(1000))
+        local bs = npge.model.BlockSet({s1, s2, s3}, {})
+        local hits = npge.algo.NativeHits(bs, bs)
+        assert.equal(#hits:sequences(), 3)
+        assert.equal(#hits:blocks(), 1)
+        checkHit(hits:blocks()[1])
+        -- subset
+        local hits2 = npge.algo.NativeHits(
+            npge.model.BlockSet({s1, s2}, {}), bs,
+            {subset = true})
+        assert.equal(#hits2:blocks(), 1)
+    end)
+
+    it("throws an error on sequence #names_conflist",
+    function()
+        local npge = require 'npge'
+        local s1a = npge.model.Sequence('s1', randomText(200))
+        local s1b = npge.model.Sequence('s1', randomText(200))
+        assert.has_error(function()
+            npge.algo.NativeHits(
+                npge.model.BlockSet({s1a}, {}),
+                npge.model.BlockSet({s1b}, {}))
+        end)
+    end)
+
+    it("gives same result for any number of workers (#workers)",
+    function()
+        local npge = require 'npge'
+        local config = require 'npge.config'
+        local seqs = {}
+        local base = randomText(3000)
+        for i = 1, 8 do
+            local text = mutate(randomText(100 * i) .. base)
+            table.insert(seqs,
+                npge.model.Sequence('s' .. i, text))
+        end
+        local bs = npge.model.BlockSet(seqs, {})
+        local function nativeHits(workers)
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local hits = npge.algo.NativeHits(bs, bs)
+            revert()
+            return hits
+        end
+        local hits = nativeHits(1)
+        assert.truthy(#hits:blocks() >= 8 * 7 / 2)
+        assert.equal(hits, nativeHits(4))
+    end)
+
+    it("is used by Workers.BlastHits if blast.NATIVE is set",
+    function()
+        local npge = require 'npge'
+        local config = require 'npge.config'
+        local text = randomText(1000)
+        local s1 = npge.model.Sequence('s1', text)
+        local s2 = npge.model.Sequence('s2', text)
+        local revert = config:updateKeys({
+            blast = {NATIVE = true},
+        })
+        local hits = npge.algo.Workers.BlastHits(
+            npge.model.BlockSet({s1}, {}),
+            npge.model.BlockSet({s2}, {}))
+        revert()
+        assert.equal(#hits:blocks(), 1)
+    end)
+end)
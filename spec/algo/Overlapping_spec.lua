@@ -34,4 +34,52 @@ describe("npge.algo.Overlapping", function()
         table.sort(both_e)
         assert.same(both, both_e)
     end)
+
+    it("get lists of blocks overlapping with #blockset",
+    function()
+        local model = require 'npge.model'
+        local seq = model.Sequence("g&c&c", ("A"):rep(100))
+        local seq2 = model.Sequence("g&c2&c", ("A"):rep(100))
+        local function makeBlocks(step)
+            local blocks = {}
+            for i = 0, 99, step do
+                local min = (i * 7) % 100
+                local max = (i * 11 + step) % 100
+                local ori = (i % 2 == 0) and 1 or -1
+                table.insert(blocks, model.Block({
+                    model.Fragment(seq, min, max, ori),
+                    model.Fragment(seq2, max, max, 1),
+                }))
+            end
+            return blocks
+        end
+        local blocks1 = makeBlocks(3)
+        local blocks2 = makeBlocks(5)
+        local bs1 = model.BlockSet({seq, seq2}, blocks1)
+        local bs2 = model.BlockSet({seq, seq2}, blocks2)
+        local Overlapping = require 'npge.algo.Overlapping'
+        local lists = Overlapping(bs1, bs2)
+        for i, block2 in ipairs(bs2:blocks()) do
+            local expected = {}
+            for _, block1 in ipairs(blocks1) do
+                local found = false
+                for f1 in block1:iterFragments() do
+                    for f2 in block2:iterFragments() do
+                        if f1:common(f2) > 0 then
+                            found = true
+                        end
+                    end
+                end
+                if found then
+                    table.insert(expected, block1)
+                end
+            end
+            local blocks = Overlapping(bs1, block2)
+            table.sort(expected)
+            table.sort(blocks)
+            table.sort(lists[i])
+            assert.same(blocks, expected)
+            assert.same(lists[i], expected)
+        end
+    end)
 end)
@@ -163,6 +163,71 @@ describe("npge.algo.Workers", function()
         revert()
     end)
 
+    it("unshares blocksets if some worker failed (#unshare)",
+    function()
+        local model = require 'npge.model'
+        local BlockSet = model.BlockSet
+        local s1 = model.Sequence('s1', 'ACTG')
+        local blocks = {}
+        for i = 0, 3 do
+            table.insert(blocks, model.Block({
+                model.Fragment(s1, i, i, 1),
+            }))
+        end
+        local blockset = BlockSet({s1}, blocks)
+        local alg = [[
+            local blockset = ...
+            for block in blockset:iterBlocks() do
+                local f = block:fragments()[1]
+                assert(f:start() ~= 0, 'test')
+            end
+            return blockset
+        ]]
+        local config = require 'npge.config'
+        local Workers = require 'npge.algo.Workers'
+        for _, workers in ipairs({1, 4}) do
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local first = BlockSet.share(blockset)
+            assert.has_error(function()
+                Workers.applyToBlockset(blockset, alg,
+                    Workers.mapBlocks)
+            end)
+            local last = BlockSet.share(blockset)
+            BlockSet.unshare(first)
+            BlockSet.unshare(last)
+            revert()
+            -- handles are increasing
+            for handle = first + 1, last - 1 do
+                assert.has_error(function()
+                    BlockSet.shared(handle)
+                end)
+            end
+        end
+    end)
+
+    it("keeps blocks with many names (#subset)", function()
+        local model = require 'npge.model'
+        local s = model.Sequence('s', 'ATATATAT')
+        local b1 = model.Block({model.Fragment(s, 1, 2, 1)})
+        local b2 = model.Block({model.Fragment(s, 4, 5, 1)})
+        local blockset = model.BlockSet({s},
+            {x = b1, y = b1, z = b2})
+        local config = require 'npge.config'
+        local Workers = require 'npge.algo.Workers'
+        for _, workers in ipairs({1, 2, 4}) do
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local result = Workers.applyToBlockset(blockset,
+                "return ...", Workers.mapBlocks)
+            revert()
+            assert.equal(result:size(), 3)
+            assert.equal(result, blockset)
+        end
+    end)
+
     it("catches errors thrown in threads (in #iterators)",
     function()
         local config = require 'npge.config'
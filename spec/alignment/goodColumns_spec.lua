@@ -67,6 +67,77 @@ describe("npge.alignment.goodColumns", function()
         }, 0.5), {100, 26, 26, 26, 26, 26, 26, 100})
     end)
 
+    it("gets type of columns of large alignment", function()
+        local goodColumns = require 'npge.alignment.goodColumns'
+        local nrows = 70
+        -- columns of different types, expected score
+        local function column(good, gap, n, mismatch)
+            local c = {}
+            for i = 1, nrows do
+                c[i] = good
+            end
+            if gap then
+                c[3] = '-'
+                c[nrows] = '-'
+            end
+            if n then
+                c[nrows - 1] = 'N'
+            end
+            if mismatch then
+                c[nrows - 2] = mismatch
+            end
+            return c
+        end
+        local variants = {
+            {column('A'), 100},
+            {column('C'), 100},
+            {column('-'), 0},
+            {column('G', false, false, 'T'), 0},
+            {column('G', false, true), 0},
+            {column('T', true, true), 0},
+            {column('T', true, false, 'A'), 0},
+        }
+        local gap_column = column('C', true)
+        local columns = {}
+        local expected = {}
+        for i = 1, 300 do
+            if i % 7 == 0 and #columns > 0 and
+                    columns[#columns] ~= gap_column then
+                -- gap of length 2, score 20
+                table.insert(columns, gap_column)
+                table.insert(columns, gap_column)
+                table.insert(expected, 20)
+                table.insert(expected, 20)
+            else
+                local v = variants[(i * 13) % #variants + 1]
+                table.insert(columns, v[1])
+                table.insert(expected, v[2])
+            end
+        end
+        local rows = {}
+        for irow = 1, nrows do
+            local row = {}
+            for icol, c in ipairs(columns) do
+                row[icol] = c[irow]
+            end
+            rows[irow] = table.concat(row)
+        end
+        assert.same(expected, goodColumns(rows))
+        -- prefixes of various lengths
+        for _, length in ipairs({1, 63, 64, 65, 127, 128, 129}) do
+            local prefix = {}
+            for irow, row in ipairs(rows) do
+                prefix[irow] = row:sub(1, length)
+            end
+            local scores = goodColumns(prefix)
+            for i = 1, length do
+                if expected[i] ~= 20 then
+                    assert.equal(expected[i], scores[i])
+                end
+            end
+        end
+    end)
+
     it("returns empty table if input is empty", function()
         local goodColumns = require 'npge.alignment.goodColumns'
         assert.same(goodColumns({}), {})
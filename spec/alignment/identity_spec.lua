@@ -21,6 +21,19 @@ describe("npge.alignment.identity", function()
         assert.equal(identity({'AT', 'TT'}, 1, 1), 1)
     end)
 
+    it("finds identity of long rows (slice)", function()
+        local identity = require 'npge.alignment.identity'
+        local row1 = ("ATGCN-"):rep(30)
+        local row2 = ("ATGGN-"):rep(30)
+        local rows = {row1, row1, row2}
+        -- 3 good columns of 6
+        assert.equal(identity(rows), 0.5)
+        assert.equal(identity(rows, 0, 65), 0.5)
+        assert.equal(identity(rows, 1, 129), 65 / 129)
+        assert.equal(identity(rows, 64, 64), 0)
+        assert.equal(identity(rows, 66, 66), 1)
+    end)
+
     it("finds identity of rows (throws if bad slice)",
     function()
         local identity = require 'npge.alignment.identity'
@@ -0,0 +1,83 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+describe("npge.cpp.func string kernels", function()
+    local func = require 'npge.cpp'.func
+
+    local orig_kernels
+
+    before_each(function()
+        orig_kernels = func.stringKernels()
+    end)
+
+    after_each(function()
+        func.setStringKernels(orig_kernels)
+    end)
+
+    local function randomText(length, letters)
+        local t = {}
+        for i = 1, length do
+            local index = math.random(1, #letters)
+            t[i] = letters:sub(index, index)
+        end
+        return table.concat(t)
+    end
+
+    local function texts()
+        local result = {"", "A", "acgtn", "ATGC-N\n"}
+        local alphabets = {
+            "ATGC",
+            "ATGCNatgcn",
+            "ATGCN-atgcn",
+            "ATGCNatgcnRYKMSWBDHV-\n *",
+        }
+        local lengths = {1, 15, 16, 17, 31, 32, 33, 64, 100}
+        for _, letters in ipairs(alphabets) do
+            for _, length in ipairs(lengths) do
+                table.insert(result, randomText(length, letters))
+            end
+        end
+        -- long clean text with one bad letter
+        local clean = randomText(200, "ATGCatgcNn")
+        table.insert(result, clean:sub(1, 150) .. "R" ..
+            clean:sub(151))
+        return result
+    end
+
+    it("has scalar kernels", function()
+        local _, supported = func.stringKernels()
+        assert.truthy(#supported >= 1)
+        assert.equal("scalar", supported[1])
+    end)
+
+    it("throws on unsupported kernels", function()
+        assert.has_error(function()
+            func.setStringKernels("no such kernels")
+        end)
+    end)
+
+    it("gives same results with all kernels", function()
+        local inputs = texts()
+        func.setStringKernels("scalar")
+        local expected = {}
+        for i, text in ipairs(inputs) do
+            expected[i] = {
+                func.complement(text),
+                func.toAtgcn(text),
+                func.toAtgcnAndGap(text),
+            }
+        end
+        local _, supported = func.stringKernels()
+        for _, name in ipairs(supported) do
+            func.setStringKernels(name)
+            assert.equal(name, func.stringKernels())
+            for i, text in ipairs(inputs) do
+                assert.equal(expected[i][1], func.complement(text))
+                assert.equal(expected[i][2], func.toAtgcn(text))
+                assert.equal(expected[i][3],
+                    func.toAtgcnAndGap(text))
+            end
+        end
+    end)
+end)
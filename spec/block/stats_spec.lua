@@ -0,0 +1,82 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+describe("npge.block.stats", function()
+    local function makeBlock(rows)
+        local model = require 'npge.model'
+        local for_block = {}
+        for i, row in ipairs(rows) do
+            local text = row:gsub('-', '')
+            local s = model.Sequence('name' .. i, text)
+            local f = model.Fragment(s, 0, s:length() - 1, 1)
+            table.insert(for_block, {f, row})
+        end
+        return model.Block(for_block)
+    end
+
+    local function checkStats(block, min_identity, min_length)
+        local stats = require 'npge.block.stats'
+        local result = stats(block, min_identity, min_length)
+        local rows = {}
+        for fragment in block:iterFragments() do
+            table.insert(rows, block:text(fragment))
+        end
+        local identity = require 'npge.alignment.identity'
+        local consensus = require 'npge.alignment.consensus'
+        local goodColumns = require 'npge.alignment.goodColumns'
+        assert.equal(identity(rows), result.identity)
+        local c = consensus(rows)
+        assert.equal(c, result.consensus)
+        assert.same(goodColumns(rows, min_identity, min_length),
+            result.good_columns)
+        assert.equal(#rows, #result.rows_identity)
+        for i, row in ipairs(rows) do
+            assert.equal(identity({c, row}),
+                result.rows_identity[i])
+        end
+    end
+
+    it("gets identity, consensus, good columns", function()
+        local block = makeBlock({
+            "AAT-AG",
+            "ACTGTG",
+            "ACTG-G",
+        })
+        local stats = require 'npge.block.stats'
+        local result = stats(block)
+        assert.equal(0.5, result.identity)
+        assert.equal("ACTGAG", result.consensus)
+        assert.same({100, 0, 100, 0, 0, 100}, result.good_columns)
+        checkStats(block)
+        checkStats(block, 0.5, 2)
+        -- same convention as block:goodColumns
+        local impl = require 'npge.cpp'.block.stats
+        assert.same(block:goodColumns(0.5, 2),
+            impl(block, 0.5, 2).good_columns)
+    end)
+
+    it("gets stats of large block", function()
+        local nrows = 55
+        local length = 200
+        local rows = {}
+        for irow = 1, nrows do
+            local row = {}
+            for i = 1, length do
+                local letter = 'A'
+                if i % 5 == 0 and (irow * i) % 7 == 1 then
+                    letter = 'T'
+                elseif i % 11 == 0 and irow % 3 == 0 then
+                    letter = '-'
+                elseif i % 13 == 0 and irow == 2 then
+                    letter = 'N'
+                end
+                row[i] = letter
+            end
+            rows[irow] = table.concat(row)
+        end
+        local block = makeBlock(rows)
+        checkStats(block)
+        checkStats(block, 0.9, 50)
+    end)
+end)
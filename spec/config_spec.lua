@@ -11,6 +11,7 @@ describe("npge.config", function()
         assert.truthy(config.general.MIN_END >= 1)
         assert.truthy(type(config.blast.DUST), 'boolean')
         assert.truthy(config.blast.EVALUE >= 0)
+        assert.truthy(type(config.blast.NATIVE), 'boolean')
         assert.truthy(config.alignment.MISMATCH_CHECK >= 1)
         assert.truthy(config.alignment.GAP_CHECK >= 1)
         assert.truthy(config.alignment.ANCHOR >= 1)
@@ -0,0 +1,113 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+local model = require 'npge.model'
+
+local function toset(list)
+    local set = {}
+    for _, item in ipairs(list) do
+        set[item] = true
+    end
+    return set
+end
+
+describe("npge.model.BlockSetBuilder", function()
+    it("adds and removes blocks", function()
+        local s = model.Sequence("g&chr&c", "ATATATAT")
+        local f1 = model.Fragment(s, 0, 1, 1)
+        local f2 = model.Fragment(s, 3, 2, -1)
+        local f3 = model.Fragment(s, 4, 5, 1)
+        local block1 = model.Block({f1, f2})
+        local block2 = model.Block({f3})
+        local builder = model.BlockSetBuilder({s})
+        assert.equal("BlockSetBuilder", builder:type())
+        assert.equal(0, builder:size())
+        assert.truthy(builder:addBlock(block1))
+        assert.falsy(builder:addBlock(block1))
+        assert.truthy(builder:addBlock(block2, "b2"))
+        assert.equal(2, builder:size())
+        assert.truthy(builder:hasBlock(block1))
+        assert.same(toset({block1, block2}),
+            toset(builder:blocks()))
+        assert.truthy(builder:removeBlock(block1))
+        assert.falsy(builder:removeBlock(block1))
+        assert.falsy(builder:hasBlock(block1))
+        assert.equal(1, builder:size())
+        local bs = builder:freeze()
+        assert.equal(model.BlockSet({s}, {b2 = block2}), bs)
+        assert.equal(block2, bs:blockByName("b2"))
+        -- builder can be used after freeze
+        builder:addBlock(block1)
+        assert.equal(2, builder:freeze():size())
+        assert.equal(1, bs:size())
+    end)
+
+    it("throws if sequence is unknown", function()
+        local s1 = model.Sequence("g1&chr&c", "ATAT")
+        local s2 = model.Sequence("g2&chr&c", "ATAT")
+        local block = model.Block({
+            model.Fragment(s1, 0, 1, 1),
+            model.Fragment(s2, 0, 1, 1),
+        })
+        local builder = model.BlockSetBuilder({s1})
+        assert.has_error(function()
+            builder:addBlock(block)
+        end)
+        assert.equal(0, builder:size())
+    end)
+
+    it("finds overlapping fragments", function()
+        -- f1      ###########
+        -- f2       #####
+        -- f3        ###########
+        -- pattern        ????
+        --         012  3 4  5 6
+        local s = model.Sequence("g&chr&c", "ATATATATAT")
+        local f1 = model.Fragment(s, 0, 5, 1)
+        local f2 = model.Fragment(s, 1, 3, 1)
+        local f3 = model.Fragment(s, 6, 2, -1)
+        local pattern = model.Fragment(s, 4, 5, 1)
+        local builder = model.BlockSetBuilder({s})
+        builder:addBlock(model.Block({f1, f2, f3}))
+        assert.same(toset({f1, f3}),
+            toset(builder:overlappingFragments(pattern)))
+        assert.same({}, builder:overlappingFragments(
+            model.Fragment(s, 7, 9, 1)))
+        -- parted fragment
+        local parted = model.Fragment(s, 9, 0, 1)
+        assert.same({f1}, builder:overlappingFragments(parted))
+        local block2 = model.Block({parted})
+        builder:addBlock(block2)
+        assert.same(toset({f1, parted}),
+            toset(builder:overlappingFragments(
+                model.Fragment(s, 0, 0, 1))))
+        builder:removeBlock(block2)
+        assert.same({f1}, builder:overlappingFragments(
+            model.Fragment(s, 0, 0, 1)))
+    end)
+
+    it("finds overlapping fragments like BlockSet", function()
+        local seq = model.Sequence("g&chr&c", ("A"):rep(200))
+        local blocks = {}
+        for i = 1, 60 do
+            local start = (i * 37) % 190
+            local length = (i * 13) % 9 + 1
+            local f = model.Fragment(seq, start,
+                start + length - 1, 1)
+            table.insert(blocks, model.Block({f}))
+        end
+        local builder = model.BlockSetBuilder({seq})
+        for _, block in ipairs(blocks) do
+            builder:addBlock(block)
+        end
+        local bs = model.BlockSet({seq}, blocks)
+        assert.equal(bs, builder:freeze())
+        for start = 0, 195 do
+            local pattern = model.Fragment(seq, start,
+                start + 4, 1)
+            assert.same(toset(bs:overlappingFragments(pattern)),
+                toset(builder:overlappingFragments(pattern)))
+        end
+    end)
+end)
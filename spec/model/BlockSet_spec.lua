@@ -120,6 +120,29 @@ describe("npge.model.BlockSet", function()
             {b1=b1, b2=b2})
     end)
 
+    it("finds names of many blocks (#hash)", function()
+        local s = model.Sequence("s", string.rep("ATGC", 100))
+        local blocks = {}
+        for i = 0, s:length() - 1 do
+            blocks["b" .. i] = model.Block({
+                model.Fragment(s, i, i, 1),
+            })
+        end
+        local blockset = model.BlockSet({s}, blocks)
+        for name, block in pairs(blocks) do
+            assert.equal(name, blockset:nameByBlock(block))
+            assert.equal(block, blockset:blockByName(name))
+            -- equal block, other object
+            local copy = model.Block({block:fragments()[1]})
+            assert.equal(name, blockset:nameByBlock(copy))
+            assert.truthy(blockset:hasBlock(copy))
+        end
+        assert.falsy(blockset:blockByName("b400"))
+        local other = model.Block({model.Fragment(s, 0, 1, 1)})
+        assert.falsy(blockset:hasBlock(other))
+        assert.equal("", blockset:nameByBlock(other))
+    end)
+
     it("gets blocks' names from other blockset", function()
         local s = model.Sequence("s", "ATAT")
         local b1 = model.Block({
@@ -170,6 +193,51 @@ describe("npge.model.BlockSet", function()
         assert.same(block2name, {[b1]="b1", [b2]="b2"})
     end)
 
+    it("creates large blockset with #workers", function()
+        local config = require 'npge.config'
+        local seqs = {}
+        for i = 1, 8 do
+            local text = string.rep("ATGC", 500)
+            local name = "g" .. i .. "&c&c"
+            table.insert(seqs, model.Sequence(name, text))
+        end
+        local blocks = {}
+        for start = 1999, 0, -1 do
+            local fragments = {}
+            for i, seq in ipairs(seqs) do
+                local ori = (i % 2 == 0) and 1 or -1
+                local stop = (start + i) % seq:length()
+                table.insert(fragments,
+                    model.Fragment(seq, start, stop, ori))
+            end
+            table.insert(blocks, model.Block(fragments))
+        end
+        local function makeBs(workers)
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local bs = model.BlockSet(seqs, blocks)
+            revert()
+            return bs
+        end
+        local bs1 = makeBs(1)
+        local bs4 = makeBs(4)
+        assert.equal(bs1, bs4)
+        for _, seq in ipairs(seqs) do
+            local ff1, ff4 = {}, {}
+            for f in bs1:iterFragments(seq) do
+                table.insert(ff1, f)
+            end
+            for f in bs4:iterFragments(seq) do
+                table.insert(ff4, f)
+            end
+            assert.same(ff1, ff4)
+            local f = model.Fragment(seq, 100, 110, 1)
+            assert.same(bs1:overlappingFragments(f),
+                bs4:overlappingFragments(f))
+        end
+    end)
+
     it("creates a blockset with 2 blocks", function()
         local s = model.Sequence("test_name", "ATAT")
         local f1 = model.Fragment(s, 0, 1, 1)
@@ -280,6 +348,40 @@ describe("npge.model.BlockSet", function()
         end
     end)
 
+    it("finds overlapping fragments (#batch)", function()
+        local seq = model.Sequence("g&chr&c", ("A"):rep(100))
+        local seq2 = model.Sequence("g&chr2&c", ("A"):rep(100))
+        local fragments = {}
+        local patterns = {}
+        for i = 0, 98, 3 do
+            local min = (i * 7) % 100
+            local max = (i * 13) % 100
+            local ori = (i % 2 == 0) and 1 or -1
+            local f = model.Fragment(seq, min, max, ori)
+            table.insert(patterns, f)
+            if i % 4 ~= 0 then
+                table.insert(fragments, f)
+            end
+        end
+        table.insert(patterns, model.Fragment(seq2, 1, 2, 1))
+        local block = model.Block(fragments)
+        local blockset = model.BlockSet({seq, seq2}, {block})
+        local results = blockset:overlappingFragments(patterns)
+        assert.equal(#results, #patterns)
+        for i, pattern in ipairs(patterns) do
+            local expected = {}
+            for _, f in ipairs(fragments) do
+                if f:common(pattern) > 0 then
+                    table.insert(expected, f)
+                end
+            end
+            assert.same(toset(results[i]), toset(expected))
+            assert.same(toset(results[i]),
+                toset(blockset:overlappingFragments(pattern)))
+        end
+        assert.same(blockset:overlappingFragments({}), {})
+    end)
+
     it("finds overlapping fragments (wrong sequence)",
     function()
         local s = model.Sequence("genome&chr&c", "ATAT")
@@ -598,6 +700,20 @@ describe("npge.model.BlockSet", function()
         assert.equal(makeBs(), makeBs())
     end)
 
+    it("compares blocksets (other alignment)", function()
+        local s1 = model.Sequence("g1&c&c", "ATAT")
+        local s2 = model.Sequence("g2&c&c", "ATA")
+        local f1 = model.Fragment(s1, 0, 3, 1)
+        local f2 = model.Fragment(s2, 0, 2, 1)
+        local b1 = model.Block({{f1, "ATAT"}, {f2, "ATA-"}})
+        local b2 = model.Block({{f1, "ATAT"}, {f2, "A-TA"}})
+        local BS = model.BlockSet
+        assert.not_equal(b1, b2)
+        assert.not_equal(BS({s1, s2}, {b1}), BS({s1, s2}, {b2}))
+        local b1a = model.Block({{f2, "ATA-"}, {f1, "ATAT"}})
+        assert.equal(BS({s1, s2}, {b1}), BS({s1, s2}, {b1a}))
+    end)
+
     it("compares blocks with many equal fragments", function()
         local s1 = model.Sequence("g1&c&c", "ATAT")
         local f1 = model.Fragment(s1, 0, 0, 1)
@@ -677,4 +793,76 @@ describe("npge.model.BlockSet", function()
         local blockset2 = BlockSet.fromRef(ref, decrease_count)
         assert.equal(blockset2:size(), 2)
     end)
+
+    it("makes subset of blockset (#subset)", function()
+        local s1 = model.Sequence("g1&c&c", "ATATATAT")
+        local s2 = model.Sequence("g2&c&c", "ATATATAT")
+        local f1 = model.Fragment(s1, 1, 2, 1)
+        local f2 = model.Fragment(s2, 7, 0, 1) -- parted
+        local f3 = model.Fragment(s1, 1, 2, 1) -- same as f1
+        local f4 = model.Fragment(s2, 2, 5, 1)
+        local b1 = model.Block({f1, f2})
+        local b2 = model.Block({f3})
+        local b3 = model.Block({f4})
+        local blockset = model.BlockSet({s1, s2},
+            {x = b1, y = b2, z = b3})
+        local subset = blockset:subset({"x", "y"})
+        local expected = model.BlockSet({s1, s2},
+            {x = b1, y = b2})
+        assert.equal(subset, expected)
+        assert.equal(subset:nameByBlock(b2), "y")
+        assert.same(subset:blocksByFragment(f1),
+            expected:blocksByFragment(f1))
+        assert.equal(#subset:blocksByFragment(f1), 2)
+        assert.same(subset:overlappingFragments(
+            model.Fragment(s2, 3, 3, 1)), {})
+        assert.equal(subset:next(f2), expected:next(f2))
+        assert.equal(blockset:subset({}),
+            model.BlockSet({s1, s2}, {}))
+        assert.equal(blockset:subset({"x", "y", "z", "x"}),
+            blockset)
+        -- blocks must belong to the blockset
+        assert.has_error(function()
+            blockset:subset({"w"})
+        end)
+    end)
+
+    it("makes subset of block with many names (#subset)",
+    function()
+        local s1 = model.Sequence("g1&c&c", "ATATATAT")
+        local b1 = model.Block({model.Fragment(s1, 1, 2, 1)})
+        local b2 = model.Block({model.Fragment(s1, 4, 5, 1)})
+        local blockset = model.BlockSet({s1},
+            {x = b1, y = b1, z = b2})
+        assert.equal(blockset:size(), 3)
+        local xz = blockset:subset({"x", "z"})
+        assert.equal(xz, model.BlockSet({s1}, {x = b1, z = b2}))
+        local names = xz:blocksNames()
+        table.sort(names)
+        assert.same(names, {"x", "z"})
+        local y = blockset:subset({"y"})
+        assert.equal(y, model.BlockSet({s1}, {y = b1}))
+        assert.equal(#y:blocksByFragment(b1:fragments()[1]), 1)
+        local xy = blockset:subset({"x", "y"})
+        assert.equal(xy, model.BlockSet({s1}, {x = b1, y = b1}))
+        assert.equal(#xy:blocksByFragment(b1:fragments()[1]), 2)
+    end)
+
+    it("shares blockset by handle (#share)", function()
+        local BlockSet = require 'npge.model.BlockSet'
+        local s1 = model.Sequence("g1&c&c", "ATAT")
+        local b1 = model.Block({model.Fragment(s1, 1, 2, 1)})
+        local handle = BlockSet.share(BlockSet({s1}, {b1}))
+        collectgarbage()
+        collectgarbage()
+        local blockset = BlockSet.shared(handle)
+        assert.equal(blockset:size(), 1)
+        assert.equal(BlockSet.unshare(handle), blockset)
+        assert.has_error(function()
+            BlockSet.shared(handle)
+        end)
+        assert.has_error(function()
+            BlockSet.unshare(handle)
+        end)
+    end)
 end)
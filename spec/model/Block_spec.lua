@@ -183,6 +183,17 @@ describe("npge.model.Block", function()
         assert.equal(
             model.Block({{f1, 'A-T'}, {f1, 'AT-'}}),
             model.Block({{f1, 'AT-'}, {f1, 'A-T'}}))
+        -- sequences with equal names and different texts
+        local s1 = model.Sequence("test_name", "ATGT")
+        local g1 = model.Fragment(s1, 0, 1, 1)
+        local g2 = model.Fragment(s1, 2, 3, 1)
+        assert.not_equal(model.Block({f1, f2}),
+            model.Block({g1, g2}))
+        local s2 = model.Sequence("test_name", "ATAT")
+        local h1 = model.Fragment(s2, 0, 1, 1)
+        local h2 = model.Fragment(s2, 2, 3, 1)
+        assert.equal(model.Block({f1, f2}),
+            model.Block({h1, h2}))
     end)
 
     it("compares blocks (<)", function()
@@ -211,4 +222,120 @@ describe("npge.model.Block", function()
         local block = model.Block({f1, f2})
         assert.truthy(tostring(block))
     end)
+
+    it("calculates identity, consensus, good columns",
+    function()
+        local model = require 'npge.model'
+        local alignment = require 'npge.alignment'
+        local rows = {
+            "AAT-AGTTGCA--A",
+            "ACTGTGTTGCA--A",
+            "ACTG-GTTG-AT-A",
+        }
+        local for_block = {}
+        for i, row in ipairs(rows) do
+            local text = row:gsub("-", "")
+            local s = model.Sequence("s" .. i, text)
+            local f = model.Fragment(s, 0, s:length() - 1, 1)
+            table.insert(for_block, {f, row})
+        end
+        local block = model.Block(for_block)
+        local block_rows = {}
+        for f in block:iterFragments() do
+            table.insert(block_rows, block:text(f))
+        end
+        local ident, good, length = block:identity()
+        assert.equal(alignment.identity(block_rows), ident)
+        assert.equal(8, good)
+        assert.equal(14, length)
+        assert.equal(alignment.consensus(block_rows),
+            block:consensus())
+        assert.same(alignment.goodColumns(block_rows),
+            block:goodColumns())
+        assert.same(alignment.goodColumns(block_rows, 0.5, 3),
+            block:goodColumns(0.5, 3))
+    end)
+
+    it("refines alignment of block", function()
+        local model = require 'npge.model'
+        local alignment = require 'npge.alignment'
+        local s1 = model.Sequence("s1", "AATAT")
+        local s2 = model.Sequence("s2", "AAT")
+        local f1 = model.Fragment(s1, 0, 4, 1)
+        local f2 = model.Fragment(s2, 0, 2, 1)
+        local block = model.Block({
+            {f1, "AATAT--"},
+            {f2, "A--A-T-"},
+        })
+        local refined = block:refine()
+        local rows = alignment.refine({
+            block:text(f1),
+            block:text(f2),
+        })
+        assert.equal(rows[1], refined:text(f1))
+        assert.equal(rows[2], refined:text(f2))
+        assert.equal(#rows[1], refined:length())
+        -- original block is not changed
+        assert.equal("A--A-T-", block:text(f2))
+    end)
+
+    it("maps lists of positions (#batch)", function()
+        local model = require 'npge.model'
+        local s1 = model.Sequence("s1", "AATATGC")
+        local f1 = model.Fragment(s1, 0, 6, 1)
+        local block = model.Block({
+            {f1, "-AAT--ATGC-"},
+        })
+        local fp = {6, 0, 3, 2}
+        assert.same({9, 1, 6, 3}, block:fragment2block(f1, fp))
+        local bp = {0, 4, 5, 10, 1}
+        assert.same({-1, -1, -1, -1, 0},
+            block:block2fragment(f1, bp))
+        assert.same({-1, 2, 2, 6, 0}, block:block2left(f1, bp))
+        assert.same({0, 3, 3, -1, 0}, block:block2right(f1, bp))
+        assert.same({}, block:block2left(f1, {}))
+        assert.has_error(function()
+            block:block2left(f1, {0, 11})
+        end)
+        assert.has_error(function()
+            block:fragment2block(f1, {"x"})
+        end)
+    end)
+
+    it("keeps #compact rows as gap runs", function()
+        local model = require 'npge.model'
+        local func = require 'npge.cpp'.func
+        assert.falsy(func.compactRows())
+        local s1 = model.Sequence("s1", "AATATGC")
+        local s2 = model.Sequence("s2", "ATGTC")
+        local f1 = model.Fragment(s1, 0, 6, 1)
+        local f2 = model.Fragment(s2, 4, 0, -1)
+        local rows = {
+            {f1, "-AAT-ATGC-"},
+            {f2, "GA--CA--T-"},
+        }
+        local plain = model.Block(rows)
+        func.setCompactRows(true)
+        local ok, compact = pcall(model.Block, rows)
+        func.setCompactRows(false)
+        assert.truthy(ok)
+        assert.equal(plain, compact)
+        assert.equal(plain:consensus(), compact:consensus())
+        assert.equal(plain:identity(), compact:identity())
+        for _, f in ipairs({f1, f2}) do
+            assert.equal(plain:text(f), compact:text(f))
+            for fp = 0, f:length() - 1 do
+                assert.equal(plain:fragment2block(f, fp),
+                    compact:fragment2block(f, fp))
+            end
+            for bp = 0, plain:length() - 1 do
+                assert.equal(plain:block2fragment(f, bp),
+                    compact:block2fragment(f, bp))
+                assert.equal(plain:block2left(f, bp),
+                    compact:block2left(f, bp))
+                assert.equal(plain:block2right(f, bp),
+                    compact:block2right(f, bp))
+            end
+        end
+    end)
 end)
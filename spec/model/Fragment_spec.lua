@@ -73,6 +73,18 @@ describe("npge.model.Fragment", function()
         assert(Fragment(s1, 0, 3, 1) < Fragment(s1, 3, 0, 1))
     end)
 
+    it("compares sequences by name, not by creation order",
+    function()
+        local s2 = model.Sequence("zzz_late&chromosome&c", "ATGC")
+        local s1 = model.Sequence("aaa_late&chromosome&c", "ATGC")
+        local s1a = model.Sequence("aaa_late&chromosome&c", "AT")
+        assert(Fragment(s1, 3, 3, 1) < Fragment(s2, 0, 0, 1))
+        assert.equal(Fragment(s1, 0, 1, 1),
+            Fragment(s1a, 0, 1, 1))
+        assert.equal(Fragment(s1, 0, 1, 1):common(
+            Fragment(s1a, 1, 1, 1)), 1)
+    end)
+
     it("sorts fragments", function()
         local s1 = model.Sequence("ABC&chromosome&c", "ATGC")
         local s2 = model.Sequence("CDF&chromosome&c", "ATGC")
@@ -153,6 +165,15 @@ describe("npge.model.Fragment", function()
         assert.are.equal(b:ori(), 1)
     end)
 
+    it("keeps #parts of parted fragment", function()
+        local s = model.Sequence("genome&chromosome&c", "ATGC")
+        local f = Fragment(s, 2, 0, 1)
+        local a1, b1 = f:parts()
+        local a2, b2 = f:parts()
+        assert.truthy(rawequal(a1, a2))
+        assert.truthy(rawequal(b1, b2))
+    end)
+
     it("parts() throws if fragment is not parted", function()
         local s = model.Sequence("genome&chromosome&c", "ATGC")
         local f = Fragment(s, 0, 0, 1)
@@ -193,6 +214,15 @@ describe("npge.model.Fragment", function()
         assert.are.equal(Fragment(s, 1, 0, 1):text(), "TGCA")
     end)
 
+    it("gets text of fragment with N", function()
+        local s = model.Sequence("genome&chromosome&c",
+            "ANNTGCAAGNCTTN")
+        assert.are.equal(Fragment(s, 1, 8, 1):text(), "NNTGCAAG")
+        assert.are.equal(Fragment(s, 8, 1, -1):text(), "CTTGCANN")
+        assert.are.equal(Fragment(s, 12, 2, 1):text(), "TNANN")
+        assert.are.equal(Fragment(s, 2, 12, -1):text(), "NNTNA")
+    end)
+
     it("makes string representation of fragment", function()
         local s = model.Sequence("genome&chromosome&c", "ATGC")
         local f = Fragment(s, 1, 2, -1)
@@ -71,6 +71,18 @@ describe("npge.model.Sequence", function()
         assert.is.falsy(s:circular())
     end)
 
+    it("gives same #genomeId to sequences of a genome",
+    function()
+        local s1 = Sequence("genome&chr1&c", "AAA")
+        local s2 = Sequence("genome&chr2&l", "AAA")
+        local s3 = Sequence("genome2&chr1&c", "AAA")
+        local s4 = Sequence("test_name", "AAA")
+        assert.equal(type(s1:genomeId()), "number")
+        assert.equal(s1:genomeId(), s2:genomeId())
+        assert.not_equal(s1:genomeId(), s3:genomeId())
+        assert.equal(s4:genomeId(), nil)
+    end)
+
     it("doesn't accept empty genome", function()
         local s = Sequence("&chr&c", "AAA")
         assert.are.equal(s:genome(), nil)
@@ -111,6 +123,18 @@ describe("npge.model.Sequence", function()
         assert.are.equal(s:sub(0, 1), 'AT')
     end)
 
+    it("gets substrings from long text with N", function()
+        local text = "ATGCNNNATTTGCNAGGCTANNNNNNNNNCCGTA"
+        local s = Sequence("test_name", text)
+        assert.are.equal(s:text(), text)
+        for min = 0, #text - 1 do
+            for max = min, #text - 1 do
+                assert.are.equal(s:sub(min, max),
+                    text:sub(min + 1, max + 1))
+            end
+        end
+    end)
+
     it("throws if sub called with bad arguments", function()
         local s = Sequence("test_name", "ATGC")
         assert.has_error(function()
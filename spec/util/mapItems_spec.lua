@@ -32,4 +32,41 @@ describe("npge.util.mapItems", function()
         table.sort(array2)
         assert.same(array2, array)
     end)
+
+    it("map items to groups of almost equal cost (#cost)",
+    function()
+        local mapItems = require 'npge.util.mapItems'
+        local array = {1, 1, 1, 1, 1, 1, 2, 2, 6, 4}
+        local function cost(item)
+            return item
+        end
+        local groups = mapItems(4, array, cost)
+        assert.equal(#groups, 4)
+        local sums = {}
+        local array2 = {}
+        for _, group in ipairs(groups) do
+            local sum = 0
+            for _, item in ipairs(group) do
+                sum = sum + item
+                table.insert(array2, item)
+            end
+            table.insert(sums, sum)
+        end
+        table.sort(sums)
+        assert.same({4, 5, 5, 6}, sums)
+        table.sort(array2)
+        table.sort(array)
+        assert.same(array2, array)
+    end)
+
+    it("puts costly item to separate group", function()
+        local mapItems = require 'npge.util.mapItems'
+        local array = {1, 1, 1, 1, 100, 1, 1}
+        local groups = mapItems(2, array, function(item)
+            return item
+        end)
+        local big_group = (#groups[1] == 1) and 1 or 2
+        assert.same({100}, groups[big_group])
+        assert.equal(6, #groups[3 - big_group])
+    end)
 end)
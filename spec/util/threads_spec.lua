@@ -92,4 +92,223 @@ describe("npge.util.threads", function()
         --
         revert()
     end)
+
+    it("keeps Lua states of workers between calls (#warm)",
+    function()
+        local config = require 'npge.config'
+        local revert = config:updateKeys({
+            util = {WORKERS = 2},
+        })
+        --
+        local threads = require 'npge.util.threads'
+        local function generator(n)
+            local t = {}
+            for i = 1, n do
+                table.insert(t, [[
+                WARM_CALLS = (WARM_CALLS or 0) + 1
+                return WARM_CALLS
+                ]])
+            end
+            return t
+        end
+        local function collector(results)
+            local unpack = require 'npge.util.unpack'
+            return math.max(unpack(results))
+        end
+        local max_calls = 0
+        for i = 1, 5 do
+            local calls = threads(generator, collector)
+            max_calls = math.max(max_calls, calls)
+        end
+        -- 10 jobs were run in 2 Lua states
+        assert.truthy(max_calls >= 5)
+        --
+        revert()
+    end)
+
+    it("updates config of Lua states of workers", function()
+        local config = require 'npge.config'
+        local threads = require 'npge.util.threads'
+        local function generator(n)
+            local t = {}
+            for i = 1, n do
+                table.insert(t, [[
+                local config = require 'npge.config'
+                return config.general.MIN_LENGTH
+                ]])
+            end
+            return t
+        end
+        for _, min_length in ipairs({200, 300, 200}) do
+            local revert = config:updateKeys({
+                general = {MIN_LENGTH = min_length},
+                util = {WORKERS = 3},
+            })
+            local results = threads(generator, function(r)
+                return r
+            end)
+            assert.same({min_length, min_length, min_length},
+                results)
+            revert()
+        end
+    end)
+
+    it("runs nested calls in the thread of worker", function()
+        local config = require 'npge.config'
+        local revert = config:updateKeys({
+            util = {WORKERS = 2},
+        })
+        --
+        local threads = require 'npge.util.threads'
+        local sums = threads(function(n)
+            local t = {}
+            for i = 1, n do
+                table.insert(t, [[
+                local threads = require 'npge.util.threads'
+                return threads(function(n)
+                    local t = {}
+                    for i = 1, n do
+                        table.insert(t, "return 1")
+                    end
+                    return t
+                end, function(results)
+                    return #results
+                end)
+                ]])
+            end
+            return t
+        end, function(results)
+            return results
+        end)
+        assert.same({2, 2}, sums)
+        --
+        revert()
+    end)
+
+    it("skips nils and extra results of codes (#results)",
+    function()
+        local config = require 'npge.config'
+        local threads = require 'npge.util.threads'
+        for _, workers in ipairs({1, 2}) do
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local results = threads(function(n)
+                return {"return", "return 1, 2", "return nil"}
+            end, function(results)
+                return results
+            end)
+            revert()
+            assert.same(results, {1})
+        end
+    end)
+
+    it("keeps integer results of workers (#integer)",
+    function()
+        local config = require 'npge.config'
+        local threads = require 'npge.util.threads'
+        for _, workers in ipairs({1, 2}) do
+            local revert = config:updateKeys({
+                util = {WORKERS = workers},
+            })
+            local results = threads(function(n)
+                return {"return 1", "return 1.5"}
+            end, function(results)
+                return results
+            end)
+            revert()
+            assert.same({1, 1.5}, results)
+            assert.equal("1", tostring(results[1]))
+            if math.type then
+                assert.equal("integer", math.type(results[1]))
+                assert.equal("float", math.type(results[2]))
+            end
+        end
+    end)
+
+    it("reports errors of workers", function()
+        local config = require 'npge.config'
+        local revert = config:updateKeys({
+            util = {WORKERS = 2},
+        })
+        --
+        local threads = require 'npge.util.threads'
+        assert.has_error(function()
+            threads(function(n)
+                return {"return 1", "error('bad code')"}
+            end, function() end)
+        end)
+        --
+        revert()
+    end)
+
+    it("shares model objects between threads (#stress)",
+    function()
+        -- too slow
+        if package.loaded.luacov then
+            return
+        end
+        if os.getenv('UNDER_VALGRIND') then
+            return
+        end
+        --
+        local config = require 'npge.config'
+        local revert = config:updateKeys({
+            util = {WORKERS = 16},
+        })
+        --
+        local model = require 'npge.model'
+        local seq = model.Sequence("g&c&c", string.rep("ATGC", 25))
+        local blocks = {}
+        for i = 0, 49 do
+            local f1 = model.Fragment(seq, i, i + 49, 1)
+            local f2 = model.Fragment(seq, 99 - i, 50 - i, -1)
+            table.insert(blocks, model.Block({f1, f2}))
+        end
+        local bs = model.BlockSet({seq}, blocks)
+        local handle = model.BlockSet.share(bs)
+        -- each worker copies and drops references to
+        -- the same Sequence and Fragments many times
+        local code = [[
+            local model = require 'npge.model'
+            local bs = model.BlockSet.shared(%d)
+            local seq = bs:sequences()[1]
+            for _ = 1, 100 do
+                local fragments = {}
+                for block in bs:iterBlocks() do
+                    for f in block:iterFragments() do
+                        table.insert(fragments, f)
+                        local copy = model.Fragment(seq,
+                            f:start(), f:stop(), f:ori())
+                        assert(copy == f)
+                    end
+                end
+                local block = model.Block(fragments)
+                local bs1 = model.BlockSet({seq}, {block})
+                assert(bs1:sequences()[1] == seq)
+                local sub = bs:subset(bs:blocksNames())
+                assert(sub == bs)
+                collectgarbage()
+            end
+            return bs:size()
+        ]]
+        local threads = require 'npge.util.threads'
+        local sizes = threads(function(n)
+            local t = {}
+            for i = 1, n do
+                table.insert(t, code:format(handle))
+            end
+            return t
+        end, function(results)
+            return results
+        end)
+        model.BlockSet.unshare(handle)
+        assert.equal(16, #sizes)
+        for _, size in ipairs(sizes) do
+            assert.equal(50, size)
+        end
+        assert.equal(bs, model.BlockSet({seq}, blocks))
+        --
+        revert()
+    end)
 end)
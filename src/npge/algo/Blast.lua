@@ -37,7 +37,13 @@ function Blast.checkNoCollisions(bs1, bs2)
     end
 end
 
-function Blast.blastnCmd(bank_fname, query_fname)
+-- fields of tabular output, see BlastReader
+Blast.TABULAR_FIELDS =
+    'qseqid stitle qstart qend sstart send btop'
+
+function Blast.blastnCmd(bank_fname, query_fname, options)
+    -- options: tabular, line_handler, see BlastHits
+    options = options or {}
     local config = require 'npge.config'
     local nullName = require 'npge.util.nullName'
     local args = {
@@ -47,8 +53,16 @@ function Blast.blastnCmd(bank_fname, query_fname)
         '-query', query_fname,
         '-evalue', tostring(config.blast.EVALUE),
         '-dust', (config.blast.DUST and 'yes' or 'no'),
-        '2>', nullName(),
     }
+    if options.tabular and not options.line_handler then
+        -- comment lines of format 7 are printed even if
+        -- no hits are found
+        table.insert(args, '-outfmt')
+        table.insert(args,
+            string.format('"7 %s"', Blast.TABULAR_FIELDS))
+    end
+    table.insert(args, '2>')
+    table.insert(args, nullName())
     return table.concat(args, ' ')
 end
 
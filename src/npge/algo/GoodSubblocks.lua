@@ -2,14 +2,10 @@
 -- Copyright (C) 2014-2016 Boris Nagaev
 -- See the LICENSE file for terms of use.
 
+-- Applies npge.block.goodSubblocks to each block
+-- in config.util.WORKERS native threads.
+
 return function(blockset)
-    local blocks = {}
-    local goodSubblocks = require 'npge.block.goodSubblocks'
-    for block in blockset:iterBlocks() do
-        for _, subblock in ipairs(goodSubblocks(block)) do
-            table.insert(blocks, subblock)
-        end
-    end
-    local BlockSet = require 'npge.model.BlockSet'
-    return BlockSet(blockset:sequences(), blocks)
+    local MapBlocks = require 'npge.cpp'.algo.MapBlocks
+    return MapBlocks(blockset, "goodSubblocks")
 end
@@ -0,0 +1,25 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+-- Finds hits like npge.algo.BlastHits without blastn.
+-- Seeds are minimizers shared by query and bank,
+-- extended by banded X-drop alignment
+-- in config.util.WORKERS native threads.
+-- Hits shorter than config.general.MIN_LENGTH are dropped.
+
+return function(query, bank, options)
+    -- possible options:
+    -- - subset - if truthy, then query is interpreted as
+    --   a subset of bank, see npge.algo.BlastHits
+    options = options or {}
+    local BlockSet = require 'npge.model.BlockSet'
+    if #query:sequences() == 0 or #bank:sequences() == 0 then
+        return BlockSet({}, {})
+    end
+    local Blast = require 'npge.algo.Blast'
+    Blast.checkNoCollisions(query, bank)
+    local same = (query == bank) or options.subset
+    local NativeHits = require 'npge.cpp'.algo.NativeHits
+    return NativeHits(query, bank, same)
+end
@@ -4,23 +4,34 @@
 
 local Workers = {}
 
+-- cost of processing a block
+Workers.blockCost = function(block)
+    return block:size() * block:length()
+end
+
+-- buckets are subsets of the blockset, fragments are not
+-- sorted again. Buckets have almost equal sums of costs.
+-- Names are mapped, because a block can have many names
 Workers.mapBlocks = function(workers, blockset)
     local mapItems = require 'npge.util.mapItems'
-    local buckets = mapItems(workers, blockset:blocks())
-    local BlockSet = require 'npge.model.BlockSet'
-    local sequences = blockset:sequences()
+    local buckets = mapItems(workers, blockset:blocksNames(),
+        function(name)
+            return Workers.blockCost(blockset:blockByName(name))
+        end)
     local blocksets = {}
     for i = 1, workers do
-        local blocks = buckets[i]
-        local bs = BlockSet(sequences, blocks)
-        table.insert(blocksets, bs)
+        local names = buckets[i]
+        table.insert(blocksets, blockset:subset(names))
     end
     return blocksets
 end
 
 Workers.mapSequences = function(workers, blockset)
     local mapItems = require 'npge.util.mapItems'
-    local buckets = mapItems(workers, blockset:sequences())
+    local buckets = mapItems(workers, blockset:sequences(),
+        function(sequence)
+            return sequence:length()
+        end)
     local BlockSet = require 'npge.model.BlockSet'
     local blocksets = {}
     for i = 1, workers do
@@ -31,19 +42,34 @@ Workers.mapSequences = function(workers, blockset)
     return blocksets
 end
 
+-- blocksets are passed by handles (see BlockSet.share)
 local workerCode = [[
-local ref = %q
+local handle = %d
 local alg = %q
 local BlockSet = require 'npge.model.BlockSet'
-local decrease_count = true
-local bs = BlockSet.fromRef(ref, decrease_count)
+local bs = BlockSet.unshare(handle)
 local loadstring = require 'npge.util.loadstring'
 local algorithm = loadstring(alg)
 bs = assert(algorithm(bs))
-local increase_count = true
-return BlockSet.toRef(bs, increase_count)
+return BlockSet.share(bs)
 ]]
 
+-- shares blocksets while function f is running
+-- f gets array of handles
+local function withShared(blocksets, f)
+    local BlockSet = require 'npge.model.BlockSet'
+    local handles = {}
+    for i, bs in ipairs(blocksets) do
+        handles[i] = BlockSet.share(bs)
+    end
+    local ok, result = pcall(f, handles)
+    for _, handle in ipairs(handles) do
+        BlockSet.unshare(handle)
+    end
+    assert(ok, result)
+    return result
+end
+
 -- Map-reduce for algorithms on blocks.
 -- 1. Splits the blockset into buckets using function
 --    Workers.mapBlocks or Workers.mapSequences (argument map)
@@ -52,16 +78,17 @@ return BlockSet.toRef(bs, increase_count)
 --    a blockset.
 Workers.applyToBlockset = function(blockset, alg, map)
     local threads = require 'npge.util.threads'
+    local BlockSet = require 'npge.model.BlockSet'
+    local input_handles = {}
     return threads(
     -- generator
     function(workers)
         local codes = {}
         local blocksets = map(workers, blockset)
-        local BlockSet = require 'npge.model.BlockSet'
         for _, bs in ipairs(blocksets) do
-            local increase_count = true
-            local ref = BlockSet.toRef(bs, increase_count)
-            table.insert(codes, workerCode:format(ref, alg))
+            local handle = BlockSet.share(bs)
+            table.insert(input_handles, handle)
+            table.insert(codes, workerCode:format(handle, alg))
         end
         return codes
     end,
@@ -69,24 +96,28 @@ Workers.applyToBlockset = function(blockset, alg, map)
     function(results)
         local blocksets = {}
         local BlockSet = require 'npge.model.BlockSet'
-        for _, ref in ipairs(results) do
-            local decrease_count = true
-            local bs = BlockSet.fromRef(ref, decrease_count)
-            table.insert(blocksets, bs)
+        for _, handle in ipairs(results) do
+            table.insert(blocksets, BlockSet.unshare(handle))
         end
         local Merge = require 'npge.algo.Merge'
         return Merge(blocksets)
+    end,
+    -- cleanup, if some worker failed
+    function(results)
+        -- codes which were not run keep their input
+        for _, handle in ipairs(input_handles) do
+            pcall(BlockSet.unshare, handle)
+        end
+        for _, handle in ipairs(results) do
+            BlockSet.unshare(handle)
+        end
     end)
 end
 
+-- runs in the native thread pool, no Lua states are created
 Workers.GoodSubblocks = function(blockset)
-    local code = [[
-        local bs = ...
-        local GS = require 'npge.algo.GoodSubblocks'
-        return GS(bs)
-    ]]
-    return Workers.applyToBlockset(blockset, code,
-        Workers.mapBlocks)
+    local GoodSubblocks = require 'npge.algo.GoodSubblocks'
+    return GoodSubblocks(blockset)
 end
 
 Workers.BlastHits = function(query, bank)
@@ -94,6 +125,12 @@ Workers.BlastHits = function(query, bank)
     if #query:sequences() == 0 or #bank:sequences() == 0 then
         return BlockSet({}, {})
     end
+    local config = require 'npge.config'
+    if config.blast.NATIVE then
+        -- uses native threads itself
+        local NativeHits = require 'npge.algo.NativeHits'
+        return NativeHits(query, bank)
+    end
     local Blast = require 'npge.algo.Blast'
     local tmpName = require 'npge.util.tmpName'
     Blast.checkNoCollisions(query, bank)
@@ -104,39 +141,45 @@ Workers.BlastHits = function(query, bank)
     local code = [[
         local BlockSet = require 'npge.model.BlockSet'
         local query = ...
-        local decrease_count = false
-        local bank = BlockSet.fromRef(%q, decrease_count)
+        local bank = BlockSet.shared(%d)
         local BlastHits = require 'npge.algo.BlastHits'
         return BlastHits(query, bank, {bank_fname=%q})
     ]]
-    local increase_count = false
-    local hits = Workers.applyToBlockset(query,
-        code:format(BlockSet.toRef(bank, increase_count),
-            bank_fname), Workers.mapSequences)
+    local hits = withShared({bank}, function(handles)
+        return Workers.applyToBlockset(query,
+            code:format(handles[1], bank_fname),
+            Workers.mapSequences)
+    end)
     os.remove(bank_cons_fname)
     Blast.bankCleanup(bank_fname)
     return hits
 end
 
 Workers.UnwindBlocks = function(consensus_bs, prefix2blockset)
-    local BlockSet = require 'npge.model.BlockSet'
-    local prefix_pairs = {}
+    local prefixes = {}
+    local blocksets = {}
     for prefix, bs in pairs(prefix2blockset) do
-        local code = "[%q] = BlockSet.fromRef(%q, false),"
-        local increase_count = false
-        local ref = BlockSet.toRef(bs, increase_count)
-        table.insert(prefix_pairs, code:format(prefix, ref))
+        table.insert(prefixes, prefix)
+        table.insert(blocksets, bs)
     end
-    local prefix_pairs_code = table.concat(prefix_pairs)
-    local code = [[
-        local BlockSet = require 'npge.model.BlockSet'
-        local consensus_bs = ...
-        local prefix2blockset = {%s}
-        local UnwindBlocks = require 'npge.algo.UnwindBlocks'
-        return UnwindBlocks(consensus_bs, prefix2blockset)
-    ]]
-    return Workers.applyToBlockset(consensus_bs,
-        code:format(prefix_pairs_code), Workers.mapBlocks)
+    return withShared(blocksets, function(handles)
+        local prefix_pairs = {}
+        for i, prefix in ipairs(prefixes) do
+            local code = "[%q] = BlockSet.shared(%d),"
+            table.insert(prefix_pairs,
+                code:format(prefix, handles[i]))
+        end
+        local prefix_pairs_code = table.concat(prefix_pairs)
+        local code = [[
+            local BlockSet = require 'npge.model.BlockSet'
+            local consensus_bs = ...
+            local prefix2blockset = {%s}
+            local Unwind = require 'npge.algo.UnwindBlocks'
+            return Unwind(consensus_bs, prefix2blockset)
+        ]]
+        return Workers.applyToBlockset(consensus_bs,
+            code:format(prefix_pairs_code), Workers.mapBlocks)
+    end)
 end
 
 return Workers
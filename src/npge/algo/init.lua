@@ -10,6 +10,7 @@ local members = {
     'UnwindBlocks',
     'Blast',
     'BlastHits',
+    'NativeHits',
     'AddGoodBlast',
     'FilterGoodBlocks',
     'BlocksWithoutOverlaps',
@@ -29,8 +29,9 @@ local function iteration(block, betterOrEqual, blockset)
         elseif f2 then
             local fstart = s2f(f1, f2:start())
             local fstop = s2f(f1, f2:stop())
-            local start = block:fragment2block(f1, fstart)
-            local stop = block:fragment2block(f1, fstop)
+            local columns = block:fragment2block(f1,
+                {fstart, fstop})
+            local start, stop = columns[1], columns[2]
             local row = block:text(f1):sub(start + 1, stop + 1)
             local prefix_len = start
             local suffix_len = block:length() - stop - 1
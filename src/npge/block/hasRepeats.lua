@@ -5,7 +5,7 @@
 return function(block)
     local genomes = {}
     for fragment in block:iterFragments() do
-        local genome = assert(fragment:sequence():genome(),
+        local genome = assert(fragment:sequence():genomeId(),
                 "Can't get genome of " .. fragment:id())
         if genomes[genome] then
             return true
@@ -3,10 +3,5 @@
 -- See the LICENSE file for terms of use.
 
 return function(block)
-    local rows = {}
-    for fragment in block:iterFragments() do
-        table.insert(rows, block:text(fragment))
-    end
-    local identity = require 'npge.alignment.identity'
-    return identity(rows)
+    return block:identity()
 end
@@ -5,6 +5,7 @@
 return {
     identity = require 'npge.block.identity',
     consensus = require 'npge.block.consensus',
+    stats = require 'npge.block.stats',
     reverse = require 'npge.block.reverse',
     orient = require 'npge.block.orient',
     slice = require 'npge.block.slice',
@@ -3,18 +3,5 @@
 -- See the LICENSE file for terms of use.
 
 return function(block)
-    local rows = {}
-    local for_block = {}
-    for f in block:iterFragments() do
-        local row = block:text(f)
-        table.insert(rows, row)
-        table.insert(for_block, {f, row})
-    end
-    local alignment = require 'npge.alignment'
-    rows = alignment.refine(rows)
-    for i = 1, #rows do
-        for_block[i][2] = rows[i]
-    end
-    local Block = require 'npge.model.Block'
-    return Block(for_block)
+    return block:refine()
 end
@@ -0,0 +1,15 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+-- Returns table with fields:
+--   identity - identity of block
+--   consensus - consensus of block
+--   good_columns - result of goodColumns
+--   rows_identity - list of identities of each row with the
+--     consensus, in order of block:fragments()
+-- Rows of block are read once.
+return function(block, min_identity, min_length)
+    local impl = require 'npge.cpp'.block.stats
+    return impl(block, min_identity, min_length)
+end
@@ -21,6 +21,9 @@ local config = {
         DUST = {false, "Filter out low complexity regions"},
 
         EVALUE = {0.001, "E-value filter for blast"},
+
+        NATIVE = {false,
+        "Use native search instead of blastn"},
     },
 
     alignment = {
@@ -289,7 +289,6 @@ static const unsigned char LETTER_TO_NUMBER[] = {
 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-typedef std::vector<int> Ints;
 typedef std::map<int, Ints> Number2Pos;
 typedef std::map<std::string, Ints> String2Pos;
 
@@ -0,0 +1,319 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "npge.hpp"
+#include "cast.hpp"
+
+namespace lnpge {
+
+// errors in blast output are reported even if asserts
+// are disabled
+static void check(bool ok, const std::string& message) {
+    if (!ok) {
+        throw std::runtime_error(message);
+    }
+}
+
+static bool isSpace(char c) {
+    return isspace((unsigned char)(c));
+}
+
+static void trim(const char*& begin, const char*& end) {
+    while (begin < end && isSpace(*begin)) {
+        begin += 1;
+    }
+    while (begin < end && isSpace(end[-1])) {
+        end -= 1;
+    }
+}
+
+static bool startsWith(const char* begin, const char* end,
+                       const char* prefix) {
+    int size = strlen(prefix);
+    return end - begin >= size &&
+           memcmp(begin, prefix, size) == 0;
+}
+
+// splits by whitespaces
+static void split(Strings& parts,
+                  const char* begin, const char* end) {
+    parts.clear();
+    while (true) {
+        while (begin < end && isSpace(*begin)) {
+            begin += 1;
+        }
+        if (begin == end) {
+            return;
+        }
+        const char* stop = begin;
+        while (stop < end && !isSpace(*stop)) {
+            stop += 1;
+        }
+        parts.push_back(std::string(begin, stop));
+        begin = stop;
+    }
+}
+
+// first word of the text
+static std::string firstWord(const char* begin,
+                             const char* end) {
+    Strings parts;
+    split(parts, begin, end);
+    check(!parts.empty(), "No name in blast output");
+    return parts[0];
+}
+
+static int toInt(const std::string& text) {
+    char* stop;
+    long value = strtol(text.c_str(), &stop, 10);
+    check(!text.empty() && *stop == 0,
+          "Bad number in blast output: " + text);
+    return value;
+}
+
+static int oriOf(int start, int stop) {
+    return (start < stop) ? 1 : -1;
+}
+
+BlastReader::BlastReader(const BlockSet& query,
+                         const BlockSet& bank, bool same):
+    query_(query), bank_(bank), same_(same),
+    empty_(true), in_hit_(false) {
+    resetHit();
+}
+
+void BlastReader::readLine(const char* line, int size) {
+    const char* begin = line;
+    const char* end = line + size;
+    empty_ = false;
+    if (memchr(begin, '\t', size)) {
+        readTabular(begin, end);
+        return;
+    }
+    trim(begin, end);
+    if (startsWith(begin, end, "#")) {
+        // comment of -outfmt 7
+    } else if (startsWith(begin, end, "Query=")) {
+        // Example: Query= consensus000567
+        tryAdd();
+        query_name_ = firstWord(begin + 6, end);
+    } else if (startsWith(begin, end, ">")) {
+        // Example: > consensus000567
+        tryAdd();
+        bank_name_ = firstWord(begin + 1, end);
+    } else if (startsWith(begin, end, "Score =")) {
+        // Example:  Score = 82.4 bits (90),  ...
+        tryAdd();
+        in_hit_ = true;
+    } else if (goodHit()) {
+        if (startsWith(begin, end, "Query ")) {
+            // Example: Query  1  GCGCG  5
+            readRow(query_row_, query_start_, query_stop_,
+                    begin, end);
+        } else if (startsWith(begin, end, "Sbjct ")) {
+            // Example: Sbjct  1  GCGCG  5
+            readRow(bank_row_, bank_start_, bank_stop_,
+                    begin, end);
+        }
+    }
+}
+
+BlockSetPtr BlastReader::blockSet(int workers) {
+    tryAdd();
+    if (empty_) {
+        throw std::runtime_error("blastn returned empty file");
+    }
+    Sequences sequences;
+    for (int i = 0; i < bank_.sequencesNumber(); i++) {
+        sequences.push_back(bank_.sequenceAt(i));
+    }
+    if (!same_) {
+        for (int i = 0; i < query_.sequencesNumber(); i++) {
+            const SequencePtr& seq = query_.sequenceAt(i);
+            if (!bank_.sequenceByName(seq->name())) {
+                sequences.push_back(seq);
+            }
+        }
+    }
+    Strings names;
+    for (int i = 0; i < blocks_.size(); i++) {
+        names.push_back(TO_S(i + 1));
+    }
+    return BlockSet::make(sequences, blocks_, names, workers);
+}
+
+bool BlastReader::goodHit() const {
+    return in_hit_ && !query_name_.empty() &&
+           !bank_name_.empty() &&
+           (!same_ || query_name_ <= bank_name_);
+}
+
+void BlastReader::resetHit() {
+    in_hit_ = false;
+    query_row_.clear();
+    bank_row_.clear();
+    query_start_ = query_stop_ = 0;
+    bank_start_ = bank_stop_ = 0;
+}
+
+void BlastReader::readRow(std::string& row,
+                          int& start, int& stop,
+                          const char* begin, const char* end) {
+    Strings parts;
+    split(parts, begin, end);
+    check(parts.size() == 4 || parts.size() == 2,
+          "Bad alignment line in blast output");
+    if (parts.size() == 4) {
+        if (start == 0) {
+            start = toInt(parts[1]);
+        }
+        stop = toInt(parts[3]);
+        row += parts[2];
+    } else {
+        row += parts[1];
+    }
+}
+
+void BlastReader::tryAdd() {
+    if (goodHit()) {
+        check(query_start_ && query_stop_ &&
+              bank_start_ && bank_stop_,
+              "No coordinates of hit in blast output");
+        FragmentPtr query_f, bank_f;
+        makeFragments(query_f, bank_f,
+                      query_name_, bank_name_,
+                      query_start_, query_stop_,
+                      bank_start_, bank_stop_);
+        addHit(query_f, bank_f, query_row_, bank_row_);
+    }
+    resetHit();
+}
+
+// BTOP: numbers are lengths of runs of identical letters,
+// pairs of letters are mismatches or gaps (query, bank).
+// Identical letters are taken from query_text
+static void btopToRows(std::string& query_row,
+                       std::string& bank_row,
+                       const std::string& btop,
+                       const std::string& query_text) {
+    int pos = 0; // in query_text
+    int i = 0;
+    int size = btop.size();
+    while (i < size) {
+        if (isdigit((unsigned char)(btop[i]))) {
+            int n = 0;
+            while (i < size &&
+                    isdigit((unsigned char)(btop[i]))) {
+                n = n * 10 + (btop[i] - '0');
+                i += 1;
+            }
+            check(pos + n <= query_text.size(),
+                  "BTOP is longer than query");
+            query_row.append(query_text, pos, n);
+            bank_row.append(query_text, pos, n);
+            pos += n;
+        } else {
+            check(i + 1 < size, "Bad BTOP in blast output");
+            char q = btop[i];
+            char b = btop[i + 1];
+            query_row += q;
+            bank_row += b;
+            if (q != '-') {
+                pos += 1;
+            }
+            i += 2;
+        }
+    }
+    check(pos == query_text.size(),
+          "BTOP does not match query");
+}
+
+// line of -outfmt 6 or 7 with fields
+// qseqid stitle qstart qend sstart send btop.
+// sseqid is not used, because it is gnl|BL_ORD_ID|N
+// unless the bank is built with -parse_seqids.
+// Name of bank sequence is the first word of stitle
+void BlastReader::readTabular(const char* begin,
+                              const char* end) {
+    Strings fields;
+    while (true) {
+        const char* stop = static_cast<const char*>(
+            memchr(begin, '\t', end - begin));
+        if (!stop) {
+            stop = end;
+        }
+        const char* b = begin;
+        const char* e = stop;
+        trim(b, e);
+        fields.push_back(std::string(b, e));
+        if (stop == end) {
+            break;
+        }
+        begin = stop + 1;
+    }
+    check(fields.size() == 7,
+          "Bad number of fields in blast output");
+    const std::string& query_name = fields[0];
+    std::string bank_name = firstWord(fields[1].c_str(),
+            fields[1].c_str() + fields[1].size());
+    if (same_ && query_name > bank_name) {
+        return;
+    }
+    FragmentPtr query_f, bank_f;
+    makeFragments(query_f, bank_f, query_name, bank_name,
+                  toInt(fields[2]), toInt(fields[3]),
+                  toInt(fields[4]), toInt(fields[5]));
+    std::string query_row, bank_row;
+    btopToRows(query_row, bank_row, fields[6],
+               query_f->text());
+    addHit(query_f, bank_f, query_row, bank_row);
+}
+
+void BlastReader::makeFragments(FragmentPtr& query_f,
+                                FragmentPtr& bank_f,
+                                const std::string& query_name,
+                                const std::string& bank_name,
+                                int query_start,
+                                int query_stop,
+                                int bank_start,
+                                int bank_stop) const {
+    SequencePtr query_seq = query_.sequenceByName(query_name);
+    check(query_seq != 0,
+          "No sequence " + query_name + " in query");
+    query_f = Fragment::make(query_seq,
+            query_start - 1, query_stop - 1,
+            oriOf(query_start, query_stop));
+    SequencePtr bank_seq = bank_.sequenceByName(bank_name);
+    check(bank_seq != 0,
+          "No sequence " + bank_name + " in bank");
+    bank_f = Fragment::make(bank_seq,
+            bank_start - 1, bank_stop - 1,
+            oriOf(bank_start, bank_stop));
+}
+
+void BlastReader::addHit(const FragmentPtr& query_f,
+                         const FragmentPtr& bank_f,
+                         const std::string& query_row,
+                         const std::string& bank_row) {
+    if (same_ && !(*query_f < *bank_f)) {
+        return;
+    }
+    Fragments fragments;
+    fragments.push_back(query_f);
+    fragments.push_back(bank_f);
+    CStrings rows;
+    rows.push_back(CString(query_row.c_str(),
+                           query_row.size()));
+    rows.push_back(CString(bank_row.c_str(),
+                           bank_row.size()));
+    blocks_.push_back(Block::make(fragments, rows));
+}
+
+}
@@ -0,0 +1,218 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+#include "cast.hpp"
+
+namespace lnpge {
+
+bool BuilderPart::operator<(const BuilderPart& other) const {
+    if (min_ != other.min_) {
+        return min_ < other.min_;
+    }
+    if (max_ != other.max_) {
+        return max_ < other.max_;
+    }
+    if (fragment_ != other.fragment_) {
+        return fragment_ < other.fragment_;
+    }
+    return block_ < other.block_;
+}
+
+static BuilderPart makePart(const FragmentPtr& part,
+                            const FragmentPtr& fragment,
+                            const Block* block) {
+    BuilderPart result;
+    result.min_ = fragmentMin(*part);
+    result.max_ = fragmentMax(*part);
+    result.fragment_ = fragment;
+    result.block_ = block;
+    return result;
+}
+
+// parts of fragment (fragment itself if it is not parted)
+static Fragments fragmentParts(const FragmentPtr& fragment) {
+    Fragments result;
+    if (fragment->parted()) {
+        const TwoFragments& two = fragment->parts();
+        result.push_back(two.first);
+        result.push_back(two.second);
+    } else {
+        result.push_back(fragment);
+    }
+    return result;
+}
+
+BlockSetBuilder::BlockSetBuilder():
+    next_name_(1) {
+}
+
+BlockSetBuilderPtr BlockSetBuilder::make(
+        const Sequences& sequences) {
+    BlockSetBuilder* builder = new BlockSetBuilder;
+    BlockSetBuilderPtr ptr(builder);
+    builder->sequences_ = sequences;
+    BOOST_FOREACH (const SequencePtr& seq, sequences) {
+        BuilderSeqRecord& record =
+            builder->seq_records_[seq->name()];
+        ASSERT_MSG(!record.sequence_,
+                   ("Duplicate sequence: " +
+                    seq->name()).c_str());
+        record.sequence_ = seq;
+        record.max_length_ = 0;
+    }
+    return ptr;
+}
+
+bool BlockSetBuilder::addBlock(const BlockPtr& block,
+                               const std::string& name) {
+    ASSERT_GT(name.size(), 0);
+    if (hasBlock(block)) {
+        return false;
+    }
+    addParts(block);
+    block2name_[block] = name;
+    return true;
+}
+
+bool BlockSetBuilder::addBlock(const BlockPtr& block) {
+    if (hasBlock(block)) {
+        return false;
+    }
+    std::string name = TO_S(next_name_);
+    next_name_ += 1;
+    return addBlock(block, name);
+}
+
+bool BlockSetBuilder::removeBlock(const BlockPtr& block) {
+    if (!hasBlock(block)) {
+        return false;
+    }
+    removeParts(block);
+    block2name_.erase(block);
+    return true;
+}
+
+bool BlockSetBuilder::hasBlock(const BlockPtr& block) const {
+    return block2name_.find(block) != block2name_.end();
+}
+
+int BlockSetBuilder::size() const {
+    return block2name_.size();
+}
+
+Blocks BlockSetBuilder::blocks() const {
+    Blocks result;
+    result.reserve(block2name_.size());
+    typedef std::map<BlockPtr, std::string>::const_iterator It;
+    for (It it = block2name_.begin();
+            it != block2name_.end(); ++it) {
+        result.push_back(it->first);
+    }
+    return result;
+}
+
+void BlockSetBuilder::addParts(const BlockPtr& block) {
+    // check all sequences first not to add a block partially
+    BOOST_FOREACH (const FragmentPtr& f, block->fragments()) {
+        const std::string& name = f->sequence()->name();
+        bool found = (seq_records_.find(name) !=
+                      seq_records_.end());
+        ASSERT_MSG(found, ("Sequence not in BlockSetBuilder: " +
+                           name).c_str());
+    }
+    BOOST_FOREACH (const FragmentPtr& f, block->fragments()) {
+        const std::string& name = f->sequence()->name();
+        BuilderSeqRecord& record = seq_records_[name];
+        BOOST_FOREACH (const FragmentPtr& part,
+                       fragmentParts(f)) {
+            record.parts_.insert(makePart(part, f,
+                                          block.get()));
+            record.max_length_ = std::max(record.max_length_,
+                                          part->length());
+        }
+    }
+}
+
+void BlockSetBuilder::removeParts(const BlockPtr& block) {
+    BOOST_FOREACH (const FragmentPtr& f, block->fragments()) {
+        const std::string& name = f->sequence()->name();
+        BuilderSeqRecord& record = seq_records_[name];
+        BOOST_FOREACH (const FragmentPtr& part,
+                       fragmentParts(f)) {
+            record.parts_.erase(makePart(part, f, block.get()));
+        }
+    }
+}
+
+void BlockSetBuilder::overlappingParts(Fragments& result,
+        const FragmentPtr& fragment) const {
+    const std::string& name = fragment->sequence()->name();
+    BuilderSeqRecords::const_iterator sit =
+        seq_records_.find(name);
+    if (sit == seq_records_.end()) {
+        return;
+    }
+    const BuilderSeqRecord& record = sit->second;
+    int min = fragmentMin(*fragment);
+    int max = fragmentMax(*fragment);
+    // parts starting before min - max_length_ + 1
+    // end before min
+    BuilderPart first;
+    first.min_ = min - record.max_length_ + 1;
+    first.max_ = first.min_;
+    first.block_ = 0;
+    BuilderParts::const_iterator it =
+        record.parts_.lower_bound(first);
+    for (; it != record.parts_.end() && it->min_ <= max; ++it) {
+        if (it->max_ >= min) {
+            result.push_back(it->fragment_);
+        }
+    }
+}
+
+Fragments BlockSetBuilder::overlapping(
+        const FragmentPtr& fragment) const {
+    Fragments result;
+    BOOST_FOREACH (const FragmentPtr& part,
+                   fragmentParts(fragment)) {
+        overlappingParts(result, part);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()),
+                 result.end());
+    return result;
+}
+
+bool BlockSetBuilder::hasOverlapping(
+        const FragmentPtr& fragment) const {
+    Fragments result;
+    BOOST_FOREACH (const FragmentPtr& part,
+                   fragmentParts(fragment)) {
+        overlappingParts(result, part);
+        if (!result.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BlockSetPtr BlockSetBuilder::freeze(int workers) const {
+    Blocks blocks;
+    Strings names;
+    typedef std::map<BlockPtr, std::string>::const_iterator It;
+    for (It it = block2name_.begin();
+            it != block2name_.end(); ++it) {
+        blocks.push_back(it->first);
+        names.push_back(it->second);
+    }
+    return BlockSet::make(sequences_, blocks, names, workers);
+}
+
+}
@@ -0,0 +1,133 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <set>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+static int lengthsSum(const Block& block) {
+    int len = 0;
+    BOOST_FOREACH (const FragmentPtr& f, block.fragments()) {
+        len += f->length();
+    }
+    return len;
+}
+
+bool blockBetter(const Block& a, const Block& b) {
+    return (a.size() > b.size()) ||
+        (a.size() == b.size() &&
+         lengthsSum(a) > lengthsSum(b));
+}
+
+struct FragmentValueLess {
+    bool operator()(const FragmentPtr& a,
+                    const FragmentPtr& b) const {
+        return *a < *b;
+    }
+};
+
+bool hasSelfOverlap(const Block& block) {
+    Fragments fragments;
+    BOOST_FOREACH (const FragmentPtr& f, block.fragments()) {
+        if (!f->parted()) {
+            fragments.push_back(f);
+        } else {
+            const TwoFragments& two = f->parts();
+            fragments.push_back(two.first);
+            fragments.push_back(two.second);
+        }
+    }
+    std::sort(fragments.begin(), fragments.end(),
+              FragmentValueLess());
+    for (int i = 1; i < fragments.size(); i++) {
+        if (fragments[i - 1]->common(*fragments[i]) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Candidate {
+    BlockPtr block_;
+    int size_;
+    int lengths_sum_;
+    bool from_orig_;
+};
+
+typedef std::vector<Candidate> Candidates;
+
+struct CandidateLess {
+    bool operator()(const Candidate& a,
+                    const Candidate& b) const {
+        if (a.size_ != b.size_) {
+            return a.size_ > b.size_;
+        }
+        if (a.lengths_sum_ != b.lengths_sum_) {
+            return a.lengths_sum_ > b.lengths_sum_;
+        }
+        return a.from_orig_ && !b.from_orig_;
+    }
+};
+
+static void addCandidates(Candidates& candidates,
+                          const BlockSet& bs,
+                          const std::set<BlockPtr>& orig) {
+    for (int i = 0; i < bs.size(); i++) {
+        Candidate c;
+        c.block_ = bs.blockAt(i);
+        c.size_ = c.block_->size();
+        c.lengths_sum_ = lengthsSum(*c.block_);
+        c.from_orig_ = (orig.find(c.block_) != orig.end());
+        candidates.push_back(c);
+    }
+}
+
+static bool overlaps(const BlockSetBuilder& builder,
+                     const Block& block) {
+    BOOST_FOREACH (const FragmentPtr& f, block.fragments()) {
+        if (builder.hasOverlapping(f)) {
+            return true;
+        }
+    }
+    return hasSelfOverlap(block);
+}
+
+BlockSetPtr blocksWithoutOverlaps(const BlockSet& orig,
+                                  const BlockSet* added) {
+    if (added) {
+        ASSERT_MSG(orig.sameSequences(*added),
+                   "Blocksets must have same sequences");
+    }
+    std::set<BlockPtr> orig_blocks;
+    for (int i = 0; i < orig.size(); i++) {
+        orig_blocks.insert(orig.blockAt(i));
+    }
+    Candidates candidates;
+    addCandidates(candidates, orig, orig_blocks);
+    if (added) {
+        addCandidates(candidates, *added, orig_blocks);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     CandidateLess());
+    Sequences sequences;
+    for (int i = 0; i < orig.sequencesNumber(); i++) {
+        sequences.push_back(orig.sequenceAt(i));
+    }
+    BlockSetBuilderPtr builder =
+        BlockSetBuilder::make(sequences);
+    BOOST_FOREACH (const Candidate& c, candidates) {
+        if (!overlaps(*builder, *c.block_)) {
+            builder->addBlock(c.block_);
+        }
+    }
+    return builder->freeze();
+}
+
+}
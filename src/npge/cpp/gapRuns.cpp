@@ -0,0 +1,156 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "sync.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+// read by threads creating blocks
+static AtomicCounter compact_rows_ = NPGE_ATOMIC_INIT(0);
+
+bool compactRows() {
+    return compact_rows_.load() != 0;
+}
+
+void setCompactRows(bool compact) {
+    compact_rows_.store(compact ? 1 : 0);
+}
+
+bool GapRun::operator==(const GapRun& other) const {
+    return start_ == other.start_ && length_ == other.length_;
+}
+
+void findGapRuns(GapRuns& runs, const char* row, int length) {
+    runs.clear();
+    int gaps = 0;
+    int bp = 0;
+    while (bp < length) {
+        if (row[bp] != '-') {
+            bp += 1;
+            continue;
+        }
+        GapRun run;
+        run.start_ = bp;
+        run.gaps_before_ = gaps;
+        while (bp < length && row[bp] == '-') {
+            bp += 1;
+        }
+        run.length_ = bp - run.start_;
+        gaps += run.length_;
+        runs.push_back(run);
+    }
+    // copy to release extra capacity
+    GapRuns(runs.begin(), runs.end()).swap(runs);
+}
+
+void applyGapRuns(char* dst, const GapRuns& runs,
+                  const char* text, int length) {
+    int bp = 0;
+    BOOST_FOREACH (const GapRun& run, runs) {
+        int letters = run.start_ - bp;
+        memcpy(dst + bp, text, letters);
+        text += letters;
+        memset(dst + run.start_, '-', run.length_);
+        bp = run.start_ + run.length_;
+    }
+    memcpy(dst + bp, text, length - bp);
+}
+
+struct RunStartLess {
+    bool operator()(int blockpos, const GapRun& run) const {
+        return blockpos < run.start_;
+    }
+};
+
+// letters of the row before the run
+static int lettersBefore(const GapRun& run) {
+    return run.start_ - run.gaps_before_;
+}
+
+struct RunLettersLess {
+    bool operator()(int fragmentpos, const GapRun& run) const {
+        return fragmentpos < lettersBefore(run);
+    }
+};
+
+// last run starting at or before blockpos or 0
+static const GapRun* runBefore(const GapRuns& runs,
+                               int blockpos) {
+    GapRuns::const_iterator it = std::upper_bound(
+            runs.begin(), runs.end(), blockpos,
+            RunStartLess());
+    if (it == runs.begin()) {
+        return 0;
+    } else {
+        return &(*(it - 1));
+    }
+}
+
+// number of letters before blockpos, sets is_gap
+static int nongapsBefore(const GapRuns& runs, int blockpos,
+                         bool& is_gap) {
+    const GapRun* run = runBefore(runs, blockpos);
+    is_gap = false;
+    if (!run) {
+        return blockpos;
+    }
+    int run_stop = run->start_ + run->length_;
+    if (blockpos < run_stop) {
+        is_gap = true;
+        return lettersBefore(*run);
+    }
+    return blockpos - run->gaps_before_ - run->length_;
+}
+
+int gapRunsFragment2block(const GapRuns& runs,
+                          int fragmentpos) {
+    GapRuns::const_iterator it = std::upper_bound(
+            runs.begin(), runs.end(), fragmentpos,
+            RunLettersLess());
+    if (it == runs.begin()) {
+        return fragmentpos;
+    }
+    const GapRun& run = *(it - 1);
+    return fragmentpos + run.gaps_before_ + run.length_;
+}
+
+int gapRunsBlock2fragment(const GapRuns& runs, int blockpos) {
+    bool is_gap;
+    int nongaps = nongapsBefore(runs, blockpos, is_gap);
+    if (is_gap) {
+        return -1;
+    } else {
+        return nongaps;
+    }
+}
+
+int gapRunsBlock2left(const GapRuns& runs, int blockpos) {
+    bool is_gap;
+    int nongaps = nongapsBefore(runs, blockpos, is_gap);
+    if (is_gap) {
+        return nongaps - 1;
+    } else {
+        return nongaps;
+    }
+}
+
+int gapRunsBlock2right(const GapRuns& runs, int blockpos,
+                       int fragment_length) {
+    bool is_gap;
+    int nongaps = nongapsBefore(runs, blockpos, is_gap);
+    if (is_gap && nongaps >= fragment_length) {
+        return -1;
+    } else {
+        return nongaps;
+    }
+}
+
+}
@@ -3,6 +3,10 @@
  * See the LICENSE file for terms of use.
  */
 
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
 #include "npge.hpp"
 
 namespace lnpge {
@@ -130,6 +134,90 @@ const int LOG_SCORE[] = {
 };
 const int LOG_SCORE_SIZE = 1000;
 
+// classes of letters used by classifyColumns
+enum {
+    LETTER_A,
+    LETTER_T,
+    LETTER_G,
+    LETTER_C,
+    LETTER_N,
+    LETTER_GAP,
+    LETTER_OTHER,
+    LETTER_CLASSES
+};
+
+struct LetterClasses {
+    unsigned char of[256];
+
+    LetterClasses() {
+        memset(of, LETTER_OTHER, sizeof(of));
+        of[int('A')] = LETTER_A;
+        of[int('T')] = LETTER_T;
+        of[int('G')] = LETTER_G;
+        of[int('C')] = LETTER_C;
+        of[int('N')] = LETTER_N;
+        of[int('-')] = LETTER_GAP;
+    }
+};
+
+static const LetterClasses LETTER_CLASSES_TABLE;
+
+// Rows are read sequentially, COLUMNS_IN_MASK letters of
+// each row. For each class of letters, the bitmask of columns
+// having a letter of the class is accumulated. Columns are
+// compared with the first row to find not identical columns.
+ColumnMasks classifyColumns(const char** rows, int nrows,
+                            int start, int length) {
+    assert(nrows > 0);
+    assert(length >= 0 && length <= COLUMNS_IN_MASK);
+    ColumnsMask any[LETTER_CLASSES];
+    memset(any, 0, sizeof(any));
+    ColumnsMask differs = 0;
+    const unsigned char* first =
+        reinterpret_cast<const unsigned char*>(rows[0] + start);
+    for (int irow = 0; irow < nrows; irow++) {
+        const unsigned char* row =
+            reinterpret_cast<const unsigned char*>(
+                    rows[irow] + start);
+        for (int j = 0; j < length; j++) {
+            ColumnsMask bit = ColumnsMask(1) << j;
+            any[LETTER_CLASSES_TABLE.of[row[j]]] |= bit;
+            differs |= ColumnsMask(row[j] != first[j]) << j;
+        }
+    }
+    ColumnsMask first_bad = 0;
+    for (int j = 0; j < length; j++) {
+        bool bad = (first[j] == '-' || first[j] == 'N');
+        first_bad |= ColumnsMask(bad) << j;
+    }
+    ColumnsMask all = (length == COLUMNS_IN_MASK) ?
+        ~ColumnsMask(0) : ((ColumnsMask(1) << length) - 1);
+    ColumnsMask a = any[LETTER_A], t = any[LETTER_T];
+    ColumnsMask g = any[LETTER_G], c = any[LETTER_C];
+    ColumnsMask two_letters = (a & t) | (g & c) |
+        ((a | t) & (g | c));
+    ColumnsMask one_letter = (a | t | g | c) & ~two_letters;
+    ColumnMasks masks;
+    masks.good = all & ~differs & ~first_bad;
+    masks.has_n = any[LETTER_N];
+    masks.ident_gap = any[LETTER_GAP] & one_letter &
+        ~masks.has_n;
+    return masks;
+}
+
+int countBits(ColumnsMask mask) {
+#ifdef __GNUC__
+    return __builtin_popcountll(mask);
+#else
+    int result = 0;
+    while (mask) {
+        mask &= mask - 1;
+        result += 1;
+    }
+    return result;
+#endif
+}
+
 static void mapGap(Scores& scores, int start, int length,
                    int min_identity, int min_length) {
     int end = start + length;
@@ -149,8 +237,9 @@ static void mapGap(Scores& scores, int start, int length,
     }
 }
 
-Scores goodColumns(const char** rows, int nrows, int length,
-                   int min_identity, int min_length) {
+Scores scoreColumns(const ColumnMasksVector& masks,
+                    int length,
+                    int min_identity, int min_length) {
     if (min_length == -1) {
         // longest than all possible gaps
         min_length = length;
@@ -162,8 +251,11 @@ Scores goodColumns(const char** rows, int nrows, int length,
     Scores scores(length);
     int gap_length = 0;
     for (int i = 0; i < length; i++) {
-        bool good = isColumnGood(rows, nrows, i);
-        bool ident_gap = isColumnIdentGap(rows, nrows, i);
+        const ColumnMasks& m = masks[i / COLUMNS_IN_MASK];
+        int j = i % COLUMNS_IN_MASK;
+        ColumnsMask bit = ColumnsMask(1) << j;
+        bool good = (m.good & bit) != 0;
+        bool ident_gap = (m.ident_gap & bit) != 0;
         if (good) {
             scores[i] = MAX_COLUMN_SCORE;
         }
@@ -183,4 +275,20 @@ Scores goodColumns(const char** rows, int nrows, int length,
     return scores;
 }
 
+Scores goodColumns(const char** rows, int nrows, int length,
+                   int min_identity, int min_length) {
+    int nmasks = (length + COLUMNS_IN_MASK - 1) /
+        COLUMNS_IN_MASK;
+    ColumnMasksVector masks(nmasks);
+    for (int k = 0; k < nmasks; k++) {
+        int start = k * COLUMNS_IN_MASK;
+        int block_length = std::min(COLUMNS_IN_MASK,
+                                    length - start);
+        masks[k] = classifyColumns(rows, nrows,
+                                   start, block_length);
+    }
+    return scoreColumns(masks, length,
+                        min_identity, min_length);
+}
+
 }
@@ -0,0 +1,127 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+// see npge.fragment.fragmentToSequence
+static int fragmentToSequence(const Fragment& fragment,
+                              int fragment_pos) {
+    int sp = fragment.start() + fragment_pos * fragment.ori();
+    int length = fragment.sequence()->length();
+    if (sp < 0) {
+        ASSERT_TRUE(fragment.parted());
+        sp += length;
+    } else if (sp >= length) {
+        ASSERT_TRUE(fragment.parted());
+        sp -= length;
+    }
+    return sp;
+}
+
+// see npge.block.slice, returns 0 if no fragments remain
+static BlockPtr slice(const Block& block, int min, int max) {
+    Fragments fragments;
+    CStrings rows;
+    std::vector<const char*> texts;
+    Strings buffers(block.size());
+    for (int i = 0; i < block.size(); i++) {
+        const FragmentPtr& f = block.fragments()[i];
+        int frag_min = block.block2right(f, min);
+        int frag_max = block.block2left(f, max);
+        if (frag_min == -1 || frag_max == -1 ||
+                frag_min > frag_max) {
+            continue;
+        }
+        int seq_min = fragmentToSequence(*f, frag_min);
+        int seq_max = fragmentToSequence(*f, frag_max);
+        fragments.push_back(Fragment::make(f->sequence(),
+                            seq_min, seq_max, f->ori()));
+        texts.push_back(block.row(i, buffers[i]).c_str());
+    }
+    if (fragments.empty()) {
+        return BlockPtr();
+    }
+    int length = max - min + 1;
+    for (int i = 0; i < texts.size(); i++) {
+        rows.push_back(CString(texts[i] + min, length));
+    }
+    return Block::make(fragments, rows);
+}
+
+// see removeMostDistant in npge.block.goodSubblocks
+static BlockPtr removeMostDistant(const Block& block,
+                                  const ColumnsStats& stats) {
+    int worst = 0;
+    for (int i = 1; i < block.size(); i++) {
+        if (stats.rows_ident[i] < stats.rows_ident[worst]) {
+            worst = i;
+        }
+    }
+    Fragments fragments;
+    Strings texts;
+    for (int i = 0; i < block.size(); i++) {
+        if (i != worst) {
+            std::string buffer;
+            texts.push_back(block.row(i, buffer));
+            fragments.push_back(block.fragments()[i]);
+        }
+    }
+    CStrings rows;
+    BOOST_FOREACH (const std::string& text, texts) {
+        rows.push_back(CString(text.c_str(), text.size()));
+    }
+    return Block::make(fragments, rows)->refine();
+}
+
+void goodSubblocks(Blocks& result, const BlockPtr& block0,
+                   const GoodSubblocksParams& params) {
+    BlockPtr block = block0;
+    while (true) {
+        if (block->length() < params.min_length_) {
+            // block is too short
+            return;
+        }
+        // block of 1 fragments: nothing to do
+        if (block->size() < 2) {
+            return;
+        }
+        // find continous groups of identical columns
+        int nrows = block->size();
+        std::vector<const char*> rows(nrows);
+        Strings buffers(nrows);
+        for (int i = 0; i < nrows; i++) {
+            rows[i] = block->row(i, buffers[i]).c_str();
+        }
+        ColumnsStats stats;
+        columnsStats(stats, &rows[0], nrows, block->length(),
+                     params.min_identity_, params.min_length_);
+        Coordinates good_slices = goodSlices(stats.scores,
+                params.frame_length_, params.min_end_,
+                params.min_identity_, params.min_length_);
+        if (!good_slices.empty()) {
+            BOOST_FOREACH (const StartStop& s, good_slices) {
+                BlockPtr subblock = slice(*block, s.first,
+                                          s.second);
+                if (subblock) {
+                    result.push_back(subblock);
+                }
+            }
+            return;
+        }
+        // block of 2 fragments: nothing to do
+        if (block->size() <= 2) {
+            return;
+        }
+        // try to remove the most distant fragment
+        block = removeMostDistant(*block, stats);
+    }
+}
+
+}
@@ -0,0 +1,72 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+// FNV-1a
+Hash hashString(const std::string& text) {
+    Hash hash = 14695981039346656037ULL;
+    for (int i = 0; i < text.size(); i++) {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// finalizer of MurmurHash3 applied to mixed value
+Hash hashCombine(Hash seed, Hash value) {
+    Hash h = seed ^ (value + 0x9e3779b97f4a7c15ULL +
+                     (seed << 6) + (seed >> 2));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void HashIndex::assign(const Hashes& hashes) {
+    int n = hashes.size();
+    int size = 1;
+    while (size < 2 * n) {
+        size *= 2;
+    }
+    mask_ = size - 1;
+    Ints(size, -1).swap(indexes_);
+    Hashes(size, 0).swap(hashes_);
+    for (int i = 0; i < n; i++) {
+        int slot = hashes[i] & mask_;
+        while (indexes_[slot] != -1) {
+            slot = (slot + 1) & mask_;
+        }
+        indexes_[slot] = i;
+        hashes_[slot] = hashes[i];
+    }
+}
+
+int HashIndex::find(Hash hash, int slot) const {
+    while (indexes_[slot] != -1) {
+        if (hashes_[slot] == hash) {
+            return slot;
+        }
+        slot = (slot + 1) & mask_;
+    }
+    return slot;
+}
+
+int HashIndex::first(Hash hash, int& slot) const {
+    slot = find(hash, hash & mask_);
+    return indexes_[slot];
+}
+
+int HashIndex::next(Hash hash, int& slot) const {
+    slot = find(hash, (slot + 1) & mask_);
+    return indexes_[slot];
+}
+
+}
@@ -0,0 +1,86 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+// Implicit interval tree over intervals sorted by min.
+// Range [lo, hi) is a subtree with root mid = (lo + hi) / 2,
+// left subtree [lo, mid) and right subtree [mid + 1, hi).
+// subtree_max_[mid] is the max of maxs_ in [lo, hi).
+// All arrays are flat, no pointers are followed.
+
+void IntervalIndex::assign(const Fragments& fragments) {
+    int n = fragments.size();
+    Ints mins(n), maxs(n);
+    for (int i = 0; i < n; i++) {
+        const Fragment& f = *fragments[i];
+        mins[i] = fragmentMin(f);
+        maxs[i] = fragmentMax(f);
+        if (i > 0) {
+            ASSERT_LTE(mins[i - 1], mins[i]);
+        }
+    }
+    mins_.swap(mins);
+    maxs_.swap(maxs);
+    subtree_max_.resize(n);
+    build(0, n);
+}
+
+int IntervalIndex::build(int lo, int hi) {
+    if (lo >= hi) {
+        return -1;
+    }
+    int mid = (lo + hi) / 2;
+    int max = maxs_[mid];
+    max = std::max(max, build(lo, mid));
+    max = std::max(max, build(mid + 1, hi));
+    subtree_max_[mid] = max;
+    return max;
+}
+
+int IntervalIndex::size() const {
+    return mins_.size();
+}
+
+int IntervalIndex::min(int index) const {
+    return mins_[index];
+}
+
+int IntervalIndex::max(int index) const {
+    return maxs_[index];
+}
+
+void IntervalIndex::find(Ints& result,
+                         int min, int max) const {
+    find(result, min, max, 0, size());
+}
+
+void IntervalIndex::find(Ints& result, int min, int max,
+                         int lo, int hi) const {
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (subtree_max_[mid] < min) {
+            // no interval of the subtree reaches min
+            return;
+        }
+        find(result, min, max, lo, mid);
+        if (mins_[mid] > max) {
+            // intervals mid and right of mid start after max
+            return;
+        }
+        if (maxs_[mid] >= min) {
+            result.push_back(mid);
+        }
+        lo = mid + 1;
+    }
+}
+
+}
@@ -4,7 +4,9 @@
  */
 
 #include <cassert>
+#include <cmath>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
@@ -14,6 +16,7 @@
 #include <lua.hpp>
 
 #include "npge.hpp"
+#include "sync.hpp"
 #include "throw_assert.hpp"
 
 using namespace lnpge;
@@ -164,6 +167,20 @@ static void lua_pushbs(lua_State* L, const BlockSetPtr& bs) {
             "npge_BlockSet", "npge_BlockSet_cache");
 }
 
+static BlockSetBuilderPtr& lua_tobuilder(lua_State* L,
+                                         int index) {
+    return fromLua<BlockSetBuilderPtr>(L, index,
+            "npge_BlockSetBuilder");
+}
+
+static void lua_pushbuilder(lua_State* L,
+                            const BlockSetBuilderPtr& builder) {
+    typedef BlockSetBuilderPtr T;
+    return toLua<T, BlockSetBuilder>(L, builder,
+            "npge_BlockSetBuilder",
+            "npge_BlockSetBuilder_cache");
+}
+
 ////////
 
 int lua_Sequence(lua_State *L) {
@@ -211,7 +228,7 @@ int lua_Sequence_description(lua_State *L) {
 
 int lua_Sequence_genome(lua_State *L) {
     const SequencePtr& seq = lua_toseq(L, 1);
-    std::string genome = seq->genome();
+    const std::string& genome = seq->genome();
     if (!genome.empty()) {
         lua_pushlstring(L, genome.c_str(), genome.size());
     } else {
@@ -222,7 +239,7 @@ int lua_Sequence_genome(lua_State *L) {
 
 int lua_Sequence_chromosome(lua_State *L) {
     const SequencePtr& seq = lua_toseq(L, 1);
-    std::string chr = seq->chromosome();
+    const std::string& chr = seq->chromosome();
     if (!chr.empty()) {
         lua_pushlstring(L, chr.c_str(), chr.size());
     } else {
@@ -231,6 +248,17 @@ int lua_Sequence_chromosome(lua_State *L) {
     return 1;
 }
 
+int lua_Sequence_genomeId(lua_State *L) {
+    const SequencePtr& seq = lua_toseq(L, 1);
+    int genome_id = seq->genomeId();
+    if (genome_id != -1) {
+        lua_pushinteger(L, genome_id);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
 int lua_Sequence_circular(lua_State *L) {
     const SequencePtr& seq = lua_toseq(L, 1);
     int circular = seq->circular();
@@ -240,8 +268,10 @@ int lua_Sequence_circular(lua_State *L) {
 
 int lua_Sequence_text(lua_State *L) {
     const SequencePtr& seq = lua_toseq(L, 1);
-    const std::string& text = seq->text();
-    lua_pushlstring(L, text.c_str(), text.size());
+    int len = seq->length();
+    char* text = newLuaArray<char>(L, len);
+    seq->sub(text, 0, len - 1, 1);
+    lua_pushlstring(L, text, len);
     return 1;
 }
 
@@ -259,8 +289,8 @@ int lua_Sequence_sub(lua_State *L) {
     ASSERT_LTE(min, max);
     ASSERT_LT(max, seq->length());
     int len = max - min + 1;
-    const std::string& text = seq->text();
-    const char* slice = text.c_str() + min;
+    char* slice = newLuaArray<char>(L, len);
+    seq->sub(slice, min, max, 1);
     lua_pushlstring(L, slice, len);
     return 1;
 }
@@ -293,6 +323,7 @@ static const luaL_Reg Sequence_methods[] = {
     {"description", lua_Sequence_description},
     {"genome", lua_Sequence_genome},
     {"chromosome", lua_Sequence_chromosome},
+    {"genomeId", lua_Sequence_genomeId},
     {"circular", lua_Sequence_circular},
     {"text", lua_Sequence_text},
     {"length", lua_Sequence_length},
@@ -365,7 +396,7 @@ int lua_Fragment_id(lua_State *L) {
 
 int lua_Fragment_parts(lua_State *L) {
     const FragmentPtr& fragment = lua_tofr(L, 1);
-    TwoFragments two = fragment->parts();
+    const TwoFragments& two = fragment->parts();
     lua_pushfr(L, two.first);
     lua_pushfr(L, two.second);
     return 2;
@@ -525,7 +556,8 @@ int lua_Block_size(lua_State *L) {
 int lua_Block_text(lua_State *L) {
     const BlockPtr& block = lua_toblock(L, 1);
     const FragmentPtr& fragment = lua_tofr(L, 2);
-    const std::string& text = block->text(fragment);
+    std::string buffer;
+    const std::string& text = block->text(fragment, buffer);
     lua_pushlstring(L, text.c_str(), text.length());
     return 1;
 }
@@ -566,7 +598,41 @@ int lua_Block_iterFragments(lua_State *L) {
     return 1;
 }
 
+typedef Ints (Block::*BatchMapping)(const FragmentPtr&,
+                                    const Ints&) const;
+
+// block:method(fragment, {pos1, pos2, ...})
+static int mapPositions(lua_State *L, BatchMapping method) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    const FragmentPtr& fragment = lua_tofr(L, 2);
+    int n = npge_rawlen(L, 3);
+    // check
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 3, i + 1); // position
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TNUMBER, 3,
+                      "list of positions expected");
+        lua_pop(L, 1); // position
+    }
+    // now fill
+    Ints positions(n);
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 3, i + 1); // position
+        positions[i] = lua_tointeger(L, -1);
+        lua_pop(L, 1); // position
+    }
+    Ints result = ((*block).*method)(fragment, positions);
+    lua_createtable(L, n, 0);
+    for (int i = 0; i < n; i++) {
+        lua_pushinteger(L, result[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
 int lua_Block_fragment2block(lua_State *L) {
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        return mapPositions(L, &Block::fragment2block);
+    }
     const BlockPtr& block = lua_toblock(L, 1);
     const FragmentPtr& fragment = lua_tofr(L, 2);
     int fp = luaL_checkinteger(L, 3);
@@ -576,6 +642,9 @@ int lua_Block_fragment2block(lua_State *L) {
 }
 
 int lua_Block_block2fragment(lua_State *L) {
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        return mapPositions(L, &Block::block2fragment);
+    }
     const BlockPtr& block = lua_toblock(L, 1);
     const FragmentPtr& fragment = lua_tofr(L, 2);
     int blockpos = luaL_checkinteger(L, 3);
@@ -585,6 +654,9 @@ int lua_Block_block2fragment(lua_State *L) {
 }
 
 int lua_Block_block2right(lua_State *L) {
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        return mapPositions(L, &Block::block2right);
+    }
     const BlockPtr& block = lua_toblock(L, 1);
     const FragmentPtr& fragment = lua_tofr(L, 2);
     int blockpos = luaL_checkinteger(L, 3);
@@ -594,6 +666,9 @@ int lua_Block_block2right(lua_State *L) {
 }
 
 int lua_Block_block2left(lua_State *L) {
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        return mapPositions(L, &Block::block2left);
+    }
     const BlockPtr& block = lua_toblock(L, 1);
     const FragmentPtr& fragment = lua_tofr(L, 2);
     int blockpos = luaL_checkinteger(L, 3);
@@ -602,6 +677,59 @@ int lua_Block_block2left(lua_State *L) {
     return 1;
 }
 
+int lua_Block_identity(lua_State *L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    double ident = block->identity();
+    double length = block->length();
+    lua_pushnumber(L, ident / length);
+    lua_pushnumber(L, ident);
+    lua_pushnumber(L, length);
+    return 3;
+}
+
+int lua_Block_consensus(lua_State *L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    std::string cons = block->consensus();
+    lua_pushlstring(L, cons.c_str(), cons.length());
+    return 1;
+}
+
+// converts identity as a double to integer (0.9 -> 90)
+// like npge.alignment.minIdentical
+static int minIdentical(double min_identity) {
+    int percents = floor(min_identity * 100 + 0.5);
+    return percents * MAX_COLUMN_SCORE / 100;
+}
+
+// arguments:
+// 1. block
+// 2. min_identity (double), optional
+// 3. min_length (integer), optional
+int lua_Block_goodColumns(lua_State *L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    const int DEFAULT_VALUE = -1;
+    int min_identity = DEFAULT_VALUE;
+    if (!lua_isnoneornil(L, 2)) {
+        min_identity = minIdentical(luaL_checknumber(L, 2));
+    }
+    int min_length = luaL_optinteger(L, 3, DEFAULT_VALUE);
+    Scores scores = block->goodColumns(min_identity,
+                                       min_length);
+    int length = scores.size();
+    lua_createtable(L, length, 0);
+    for (int i = 0; i < length; i++) {
+        lua_pushinteger(L, scores[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+int lua_Block_refine(lua_State *L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    lua_pushblock(L, block->refine());
+    return 1;
+}
+
 int lua_Block_tostring(lua_State *L) {
     const BlockPtr& block = lua_toblock(L, 1);
     std::string repr = block->tostring();
@@ -642,11 +770,59 @@ static const luaL_Reg Block_methods[] = {
     {"block2fragment", wrap<lua_Block_block2fragment>::func},
     {"block2right", wrap<lua_Block_block2right>::func},
     {"block2left", wrap<lua_Block_block2left>::func},
+    {"identity", wrap<lua_Block_identity>::func},
+    {"consensus", wrap<lua_Block_consensus>::func},
+    {"goodColumns", wrap<lua_Block_goodColumns>::func},
+    {"refine", wrap<lua_Block_refine>::func},
     {NULL, NULL}
 };
 
 //////////
 
+// return require("npge.config").util.WORKERS
+static int getWorkers(lua_State* L) {
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "npge.config");
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, "util");
+    lua_getfield(L, -1, "WORKERS");
+    int WORKERS = luaL_checkinteger(L, -1);
+    lua_pop(L, 3);
+    return WORKERS;
+}
+
+// return require("npge.config").general.MIN_LENGTH
+static int getMinLength(lua_State* L) {
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "npge.config");
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, "general");
+    lua_getfield(L, -1, "MIN_LENGTH");
+    int MIN_LENGTH = luaL_checkinteger(L, -1);
+    return MIN_LENGTH;
+}
+
+// reads section "general" of npge.config
+static GoodSubblocksParams getGoodSubblocksParams(
+        lua_State* L) {
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "npge.config");
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, "general");
+    GoodSubblocksParams params;
+    lua_getfield(L, -1, "MIN_LENGTH");
+    params.min_length_ = luaL_checkinteger(L, -1);
+    lua_getfield(L, -2, "MIN_IDENTITY");
+    double min_identity = luaL_checknumber(L, -1);
+    params.min_identity_ = minIdentical(min_identity);
+    lua_getfield(L, -3, "FRAME_LENGTH");
+    params.frame_length_ = luaL_checkinteger(L, -1);
+    lua_getfield(L, -4, "MIN_END");
+    params.min_end_ = luaL_checkinteger(L, -1);
+    lua_pop(L, 6);
+    return params;
+}
+
 // BlockSet(BlockSet, {sequences}, {blocks}, [names generator])
 int lua_BlockSet(lua_State *L) {
     luaL_argcheck(L, lua_gettop(L) >= 3, 2,
@@ -655,6 +831,7 @@ int lua_BlockSet(lua_State *L) {
                   "call BlockSet({sequences}, {blocks})");
     luaL_argcheck(L, lua_type(L, 3) == LUA_TTABLE, 3,
                   "call BlockSet({sequences}, {blocks})");
+    int workers = getWorkers(L);
     int nseqs = npge_rawlen(L, 2);
     // check all arguments are convertible to target types
     for (int i = 0; i < nseqs; i++) {
@@ -712,7 +889,8 @@ int lua_BlockSet(lua_State *L) {
         lua_pop(L, 1);
         i += 1;
     }
-    BlockSetPtr bs = BlockSet::make(seqs, blocks, names);
+    BlockSetPtr bs = BlockSet::make(seqs, blocks, names,
+                                    workers);
     lua_pushbs(L, bs);
     return 1;
 }
@@ -831,6 +1009,30 @@ int lua_BlockSet_hasBlock(lua_State *L) {
     return 1;
 }
 
+// bs:subset({names}), blocks must belong to bs
+int lua_BlockSet_subset(lua_State *L) {
+    const BlockSetPtr& bs = lua_tobs(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int nnames = npge_rawlen(L, 2);
+    // check all names before creating C++ objects
+    for (int i = 0; i < nnames; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        luaL_checkstring(L, -1);
+        lua_pop(L, 1);
+    }
+    Strings names(nnames);
+    for (int i = 0; i < nnames; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        size_t len;
+        const char* name = lua_tolstring(L, -1, &len);
+        names[i].assign(name, len);
+        lua_pop(L, 1);
+    }
+    BlockSetPtr subset = bs->subset(names);
+    lua_pushbs(L, subset);
+    return 1;
+}
+
 // first upvalue: blockset
 // second upvalue: index of block
 // yields (block, name)
@@ -966,17 +1168,92 @@ int lua_BlockSet_blocksByFragment(lua_State *L) {
     return 1;
 }
 
+static void pushFragments(lua_State *L,
+                          const Fragments& fragments) {
+    int n = fragments.size();
+    lua_createtable(L, n, 0);
+    for (int i = 0; i < n; i++) {
+        const FragmentPtr& f = fragments[i];
+        lua_pushfr(L, f);
+        lua_rawseti(L, -2, i + 1);
+    }
+}
+
+// bs:overlappingFragments({fragment1, fragment2, ...})
+static int overlappingFragmentsBatch(lua_State *L) {
+    const BlockSetPtr& bs = lua_tobs(L, 1);
+    int n = npge_rawlen(L, 2);
+    // check
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 2, i + 1); // fragment
+        lua_tofr(L, -1);
+        lua_pop(L, 1); // fragment
+    }
+    // now fill
+    Fragments fragments(n);
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 2, i + 1); // fragment
+        fragments[i] = lua_tofr(L, -1);
+        lua_pop(L, 1); // fragment
+    }
+    std::vector<Fragments> overlapping =
+        bs->overlapping(fragments);
+    lua_createtable(L, n, 0);
+    for (int i = 0; i < n; i++) {
+        pushFragments(L, overlapping[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
 int lua_BlockSet_overlappingFragments(lua_State *L) {
+    if (lua_type(L, 2) == LUA_TTABLE) {
+        return overlappingFragmentsBatch(L);
+    }
     const BlockSetPtr& bs = lua_tobs(L, 1);
     const FragmentPtr& fr = lua_tofr(L, 2);
     Fragments overlapping = bs->overlapping(fr);
-    int n = overlapping.size();
+    pushFragments(L, overlapping);
+    return 1;
+}
+
+static void pushBlocks(lua_State *L, const Blocks& blocks) {
+    int n = blocks.size();
     lua_createtable(L, n, 0);
     for (int i = 0; i < n; i++) {
-        const FragmentPtr& f = overlapping[i];
-        lua_pushfr(L, f);
+        lua_pushblock(L, blocks[i]);
         lua_rawseti(L, -2, i + 1);
     }
+}
+
+static bool isBlockSet(lua_State *L, int index) {
+    if (!lua_getmetatable(L, index)) {
+        return false;
+    }
+    luaL_getmetatable(L, "npge_BlockSet");
+    bool result = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+    return result;
+}
+
+// bs:overlappingBlocks(block) or bs:overlappingBlocks(bs2)
+int lua_BlockSet_overlappingBlocks(lua_State *L) {
+    const BlockSetPtr& bs = lua_tobs(L, 1);
+    if (isBlockSet(L, 2)) {
+        const BlockSetPtr& other = lua_tobs(L, 2);
+        std::vector<Blocks> overlapping =
+            bs->overlappingBlocks(*other);
+        int n = overlapping.size();
+        lua_createtable(L, n, 0);
+        for (int i = 0; i < n; i++) {
+            pushBlocks(L, overlapping[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+    const BlockPtr& block = lua_toblock(L, 2);
+    Blocks overlapping = bs->overlappingBlocks(block);
+    pushBlocks(L, overlapping);
     return 1;
 }
 
@@ -1031,6 +1308,30 @@ int lua_BlockSet_fromRef(lua_State *L) {
     return 1;
 }
 
+// BlockSet.share(bs) returns integer handle
+int lua_BlockSet_share(lua_State *L) {
+    const BlockSetPtr& bs = lua_tobs(L, 1);
+    lua_pushinteger(L, shareBlockSet(bs));
+    return 1;
+}
+
+// BlockSet.shared(handle) returns shared blockset
+int lua_BlockSet_shared(lua_State *L) {
+    int handle = luaL_checkinteger(L, 1);
+    BlockSetPtr bs = sharedBlockSet(handle);
+    lua_pushbs(L, bs);
+    return 1;
+}
+
+// BlockSet.unshare(handle) returns shared blockset
+// and forgets the handle
+int lua_BlockSet_unshare(lua_State *L) {
+    int handle = luaL_checkinteger(L, 1);
+    BlockSetPtr bs = unshareBlockSet(handle);
+    lua_pushbs(L, bs);
+    return 1;
+}
+
 static const luaL_Reg BlockSet_mt[] = {
     {"__gc", lua_BlockSet_gc},
     {"__tostring", lua_BlockSet_tostring},
@@ -1049,6 +1350,7 @@ static const luaL_Reg BlockSet_methods[] = {
     {"blockByName", lua_BlockSet_blockByName},
     {"nameByBlock", lua_BlockSet_nameByBlock},
     {"hasBlock", lua_BlockSet_hasBlock},
+    {"subset", wrap<lua_BlockSet_subset>::func},
     {"iterBlocks", lua_BlockSet_iterBlocks},
     {"iterFragments", wrap<lua_BlockSet_iterFragments>::func},
     {"sequences", lua_BlockSet_sequences},
@@ -1059,15 +1361,133 @@ static const luaL_Reg BlockSet_methods[] = {
     {"blocksByFragment", lua_BlockSet_blocksByFragment},
     {"overlappingFragments",
         lua_BlockSet_overlappingFragments},
+    {"overlappingBlocks",
+        wrap<lua_BlockSet_overlappingBlocks>::func},
     {"next", wrap<lua_BlockSet_next>::func},
     {"prev", wrap<lua_BlockSet_prev>::func},
     {NULL, NULL}
 };
 
+//////////
+
+// BlockSetBuilder({sequences})
+int lua_BlockSetBuilder(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int nseqs = npge_rawlen(L, 1);
+    Sequences seqs(nseqs);
+    for (int i = 0; i < nseqs; i++) {
+        lua_rawgeti(L, 1, i + 1); // sequence
+        seqs[i] = lua_toseq(L, -1);
+        lua_pop(L, 1);
+    }
+    BlockSetBuilderPtr builder = BlockSetBuilder::make(seqs);
+    lua_pushbuilder(L, builder);
+    return 1;
+}
+
+int lua_BlockSetBuilder_gc(lua_State *L) {
+    BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    builder.reset();
+    return 0;
+}
+
+int lua_BlockSetBuilder_type(lua_State *L) {
+    lua_pushstring(L, "BlockSetBuilder");
+    return 1;
+}
+
+int lua_BlockSetBuilder_size(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    lua_pushinteger(L, builder->size());
+    return 1;
+}
+
+// arguments: block, [name]
+// returns false if the block was already added
+int lua_BlockSetBuilder_addBlock(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    const BlockPtr& block = lua_toblock(L, 2);
+    bool added;
+    if (lua_isnoneornil(L, 3)) {
+        added = builder->addBlock(block);
+    } else {
+        size_t len;
+        const char* name = luaL_checklstring(L, 3, &len);
+        added = builder->addBlock(block,
+                                  std::string(name, len));
+    }
+    lua_pushboolean(L, added);
+    return 1;
+}
+
+// returns false if the block was not added
+int lua_BlockSetBuilder_removeBlock(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    const BlockPtr& block = lua_toblock(L, 2);
+    lua_pushboolean(L, builder->removeBlock(block));
+    return 1;
+}
+
+int lua_BlockSetBuilder_hasBlock(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    const BlockPtr& block = lua_toblock(L, 2);
+    lua_pushboolean(L, builder->hasBlock(block));
+    return 1;
+}
+
+int lua_BlockSetBuilder_blocks(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    Blocks blocks = builder->blocks();
+    int n = blocks.size();
+    lua_createtable(L, n, 0);
+    for (int i = 0; i < n; i++) {
+        lua_pushblock(L, blocks[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+int lua_BlockSetBuilder_overlappingFragments(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    const FragmentPtr& fr = lua_tofr(L, 2);
+    Fragments overlapping = builder->overlapping(fr);
+    int n = overlapping.size();
+    lua_createtable(L, n, 0);
+    for (int i = 0; i < n; i++) {
+        lua_pushfr(L, overlapping[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+int lua_BlockSetBuilder_freeze(lua_State *L) {
+    const BlockSetBuilderPtr& builder = lua_tobuilder(L, 1);
+    lua_pushbs(L, builder->freeze(getWorkers(L)));
+    return 1;
+}
+
+static const luaL_Reg BlockSetBuilder_mt[] = {
+    {"__gc", lua_BlockSetBuilder_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg BlockSetBuilder_methods[] = {
+    {"type", lua_BlockSetBuilder_type},
+    {"size", lua_BlockSetBuilder_size},
+    {"addBlock", wrap<lua_BlockSetBuilder_addBlock>::func},
+    {"removeBlock", lua_BlockSetBuilder_removeBlock},
+    {"hasBlock", lua_BlockSetBuilder_hasBlock},
+    {"blocks", lua_BlockSetBuilder_blocks},
+    {"overlappingFragments",
+        wrap<lua_BlockSetBuilder_overlappingFragments>::func},
+    {"freeze", wrap<lua_BlockSetBuilder_freeze>::func},
+    {NULL, NULL}
+};
+
 // table "model" is on stack index -1
 // model.BlockSet is function
 // replaces model.BlockSet with callable table
-// with member fromRef
+// with members toRef, fromRef, share, shared, unshare
 void registerBlockSetFromRef(lua_State* L) {
     lua_newtable(L); // callable table BlockSet
     lua_newtable(L); // metatable of callable table
@@ -1078,35 +1498,223 @@ void registerBlockSetFromRef(lua_State* L) {
     lua_setfield(L, -2, "toRef");
     lua_pushcfunction(L, lua_BlockSet_fromRef);
     lua_setfield(L, -2, "fromRef");
+    lua_pushcfunction(L, wrap<lua_BlockSet_share>::func);
+    lua_setfield(L, -2, "share");
+    lua_pushcfunction(L, wrap<lua_BlockSet_shared>::func);
+    lua_setfield(L, -2, "shared");
+    lua_pushcfunction(L, wrap<lua_BlockSet_unshare>::func);
+    lua_setfield(L, -2, "unshare");
     lua_setfield(L, -2, "BlockSet");
 }
 
 /////////
 
-static int lengthsSum(const BlockPtr& a) {
-    int len = 0;
-    const Fragments& fragments = a->fragments();
-    int size = a->size();
-    for (int i = 0; i < size; i++) {
-        len += fragments[i]->length();
-    }
-    return len;
-}
-
 // arguments: two blocks
 // implementation of npge.block.better
 static int lua_block_better(lua_State* L) {
     const BlockPtr& a = lua_toblock(L, 1);
     const BlockPtr& b = lua_toblock(L, 2);
-    int result = (a->size() > b->size()) ||
-        (a->size() == b->size() &&
-         lengthsSum(a) > lengthsSum(b));
-    lua_pushboolean(L, result);
+    lua_pushboolean(L, blockBetter(*a, *b));
+    return 1;
+}
+
+// arguments:
+// 1. block
+// 2. min_identity (double), optional
+// 3. min_length (integer), optional
+// returns table with fields identity, consensus,
+// good_columns and rows_identity (in order of fragments)
+int lua_block_stats(lua_State* L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    const int DEFAULT_VALUE = -1;
+    int min_identity = DEFAULT_VALUE;
+    if (!lua_isnoneornil(L, 2)) {
+        min_identity = minIdentical(luaL_checknumber(L, 2));
+    }
+    int min_length = luaL_optinteger(L, 3, DEFAULT_VALUE);
+    int nrows = block->size();
+    int length = block->length();
+    const char** rows = newLuaArray<const char*>(L, nrows);
+    Strings buffers(nrows);
+    for (int i = 0; i < nrows; i++) {
+        rows[i] = block->row(i, buffers[i]).c_str();
+    }
+    ColumnsStats stats;
+    columnsStats(stats, rows, nrows, length,
+                 min_identity, min_length);
+    lua_createtable(L, 0, 4);
+    lua_pushnumber(L, double(stats.ident) / length);
+    lua_setfield(L, -2, "identity");
+    lua_pushlstring(L, stats.consensus.c_str(), length);
+    lua_setfield(L, -2, "consensus");
+    lua_createtable(L, length, 0);
+    for (int i = 0; i < length; i++) {
+        lua_pushinteger(L, stats.scores[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "good_columns");
+    lua_createtable(L, nrows, 0);
+    for (int i = 0; i < nrows; i++) {
+        lua_pushnumber(L, double(stats.rows_ident[i]) / length);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "rows_identity");
+    return 1;
+}
+
+// arguments: block
+// implementation of npge.block.hasSelfOverlap
+int lua_block_hasSelfOverlap(lua_State* L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    lua_pushboolean(L, hasSelfOverlap(*block));
+    return 1;
+}
+
+// arguments: block
+// implementation of npge.block.goodSubblocks
+int lua_block_goodSubblocks(lua_State* L) {
+    const BlockPtr& block = lua_toblock(L, 1);
+    GoodSubblocksParams params = getGoodSubblocksParams(L);
+    Blocks subblocks;
+    goodSubblocks(subblocks, block, params);
+    pushBlocks(L, subblocks);
     return 1;
 }
 
 static const luaL_Reg block_functions[] = {
     {"better", lua_block_better},
+    {"goodSubblocks", wrap<lua_block_goodSubblocks>::func},
+    {"hasSelfOverlap", wrap<lua_block_hasSelfOverlap>::func},
+    {"stats", wrap<lua_block_stats>::func},
+    {NULL, NULL}
+};
+
+// arguments:
+// 1. blockset
+// 2. blockset (optional)
+// implementation of npge.algo.BlocksWithoutOverlaps
+int lua_BlocksWithoutOverlaps(lua_State* L) {
+    const BlockSetPtr& orig = lua_tobs(L, 1);
+    const BlockSet* added = 0;
+    if (!lua_isnoneornil(L, 2)) {
+        added = lua_tobs(L, 2).get();
+    }
+    lua_pushbs(L, blocksWithoutOverlaps(*orig, added));
+    return 1;
+}
+
+// arguments:
+// 1. blockset (partition)
+// 2. blockset (partition)
+// implementation of npge.algo.Multiply
+int lua_Multiply(lua_State* L) {
+    const BlockSetPtr& bs1 = lua_tobs(L, 1);
+    const BlockSetPtr& bs2 = lua_tobs(L, 2);
+    lua_pushbs(L, multiply(*bs1, *bs2, getWorkers(L)));
+    return 1;
+}
+
+// arguments:
+// 1. blockset
+// 2. name of kernel: "goodSubblocks" or "refine"
+// applies the kernel to blocks in config.util.WORKERS threads
+int lua_MapBlocks(lua_State* L) {
+    const BlockSetPtr& bs = lua_tobs(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    bool good_subblocks = (strcmp(name, "goodSubblocks") == 0);
+    bool refine = (strcmp(name, "refine") == 0);
+    luaL_argcheck(L, good_subblocks || refine, 2,
+                  "unknown kernel");
+    int workers = getWorkers(L);
+    GoodSubblocksParams params = getGoodSubblocksParams(L);
+    BlockSetPtr result;
+    if (good_subblocks) {
+        GoodSubblocksKernel kernel(params);
+        result = mapBlocks(*bs, kernel, workers);
+    } else {
+        RefineKernel kernel;
+        result = mapBlocks(*bs, kernel, workers);
+    }
+    lua_pushbs(L, result);
+    return 1;
+}
+
+// arguments:
+// 1. blockset (query)
+// 2. blockset (bank)
+// 3. boolean: each pair is searched once, no self-hits
+// implementation of npge.algo.NativeHits
+int lua_NativeHits(lua_State* L) {
+    const BlockSetPtr& query = lua_tobs(L, 1);
+    const BlockSetPtr& bank = lua_tobs(L, 2);
+    bool same = lua_toboolean(L, 3);
+    int workers = getWorkers(L);
+    NativeHitsParams params;
+    params.min_length_ = getMinLength(L);
+    params.same_ = same;
+    lua_pushbs(L, nativeHits(*query, *bank, params, workers));
+    return 1;
+}
+
+// arguments:
+// 1. file with output of blastn or its text
+// 2. blockset (query)
+// 3. blockset (bank)
+// 4. boolean: skip hits where query > bank
+// implementation of readBlast in npge.algo.BlastHits
+int lua_ReadBlast(lua_State* L) {
+    FILE* file = 0;
+    const char* text = 0;
+    size_t text_size = 0;
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        text = lua_tolstring(L, 1, &text_size);
+    } else {
+        // FILE* is first member of userdata in all Lua versions
+        void* ud = luaL_checkudata(L, 1, LUA_FILEHANDLE);
+        file = *reinterpret_cast<FILE**>(ud);
+        luaL_argcheck(L, file, 1, "file is closed");
+    }
+    const BlockSetPtr& query = lua_tobs(L, 2);
+    const BlockSetPtr& bank = lua_tobs(L, 3);
+    bool same = lua_toboolean(L, 4);
+    int workers = getWorkers(L);
+    BlastReader reader(*query, *bank, same);
+    if (file) {
+        std::string line;
+        char buffer[4096];
+        while (fgets(buffer, sizeof(buffer), file)) {
+            line += buffer;
+            if (line[line.size() - 1] == '\n') {
+                reader.readLine(line.c_str(), line.size());
+                line.clear();
+            }
+        }
+        if (!line.empty()) {
+            reader.readLine(line.c_str(), line.size());
+        }
+    } else {
+        const char* end = text + text_size;
+        while (text < end) {
+            const char* stop = reinterpret_cast<const char*>(
+                memchr(text, '\n', end - text));
+            if (!stop) {
+                stop = end;
+            }
+            reader.readLine(text, stop - text);
+            text = stop + 1;
+        }
+    }
+    lua_pushbs(L, reader.blockSet(workers));
+    return 1;
+}
+
+static const luaL_Reg algo_functions[] = {
+    {"BlocksWithoutOverlaps",
+        wrap<lua_BlocksWithoutOverlaps>::func},
+    {"Multiply", wrap<lua_Multiply>::func},
+    {"MapBlocks", wrap<lua_MapBlocks>::func},
+    {"NativeHits", wrap<lua_NativeHits>::func},
+    {"ReadBlast", wrap<lua_ReadBlast>::func},
     {NULL, NULL}
 };
 
@@ -1153,6 +1761,37 @@ int lua_complement(lua_State* L) {
     return 1;
 }
 
+// returns name of kernels in use and list of supported kernels
+int lua_stringKernels(lua_State* L) {
+    lua_pushstring(L, stringKernels());
+    Strings names = supportedStringKernels();
+    lua_createtable(L, names.size(), 0);
+    for (int i = 0; i < names.size(); i++) {
+        lua_pushstring(L, names[i].c_str());
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 2;
+}
+
+int lua_setStringKernels(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    if (!setStringKernels(name)) {
+        return luaL_error(L, "String kernels %s are not "
+                          "supported", name);
+    }
+    return 0;
+}
+
+int lua_compactRows(lua_State* L) {
+    lua_pushboolean(L, compactRows());
+    return 1;
+}
+
+int lua_setCompactRows(lua_State* L) {
+    setCompactRows(lua_toboolean(L, 1));
+    return 0;
+}
+
 int lua_unwindRow(lua_State *L) {
     size_t row_size, orig_size;
     const char* row = luaL_checklstring(L, 1, &row_size);
@@ -1508,17 +2147,6 @@ static int getGapCheck(lua_State* L) {
     return ANCHOR;
 }
 
-// return require("npge.config").general.MIN_LENGTH
-static int getMinLength(lua_State* L) {
-    lua_getglobal(L, "require");
-    lua_pushliteral(L, "npge.config");
-    lua_call(L, 1, 1);
-    lua_getfield(L, -1, "general");
-    lua_getfield(L, -1, "MIN_LENGTH");
-    int MIN_LENGTH = luaL_checkinteger(L, -1);
-    return MIN_LENGTH;
-}
-
 // arguments:
 // 1. Lua table with rows
 // results: nil or
@@ -1645,10 +2273,320 @@ static void registerType(lua_State *L,
     lua_setfield(L, -2, type_name);
 }
 
+///
+
+// Lua states of workers of npge.util.threads.
+// They are created on first use with npge loaded and kept
+// until the last Lua state using npge.cpp is closed.
+
+struct WorkerState {
+    lua_State* L_;
+    std::string config_; // loaded to L_
+
+    WorkerState():
+        L_(0) {
+    }
+};
+
+struct WorkerResult {
+    bool ok_;
+    int type_;
+    lua_Number number_;
+    bool is_integer_; // Lua 5.3 keeps subtype of numbers
+    lua_Integer integer_;
+    std::string text_; // value or error message
+};
+
+typedef std::vector<WorkerResult> WorkerResults;
+
+static std::vector<WorkerState> worker_states_;
+static bool worker_states_busy_ = false;
+static int npge_users_ = 0;
+static SpinLock worker_states_lock_ = NPGE_SPIN_LOCK_INIT;
+
+// returns false if the states are used by other thread
+static bool acquireWorkerStates() {
+    SpinLockGuard lock(worker_states_lock_);
+    if (worker_states_busy_) {
+        return false;
+    }
+    worker_states_busy_ = true;
+    return true;
+}
+
+static void releaseWorkerStates() {
+    SpinLockGuard lock(worker_states_lock_);
+    worker_states_busy_ = false;
+}
+
+static void closeWorkerStates() {
+    for (int i = 0; i < worker_states_.size(); i++) {
+        if (worker_states_[i].L_) {
+            lua_close(worker_states_[i].L_);
+        }
+    }
+    worker_states_.clear();
+}
+
+// message handler, see xpcall in npge.util.threads
+static int workerTraceback(lua_State* L) {
+    lua_getglobal(L, "debug");
+    lua_getfield(L, -1, "traceback");
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 2);
+    lua_call(L, 2, 1);
+    return 1;
+}
+
+// calls code with nargs arguments from top of the stack
+// leaves result or error message on top of the stack
+static bool workerCall(lua_State* L, const std::string& code,
+                       int nargs) {
+    int handler = lua_gettop(L) - nargs + 1;
+    lua_pushcfunction(L, workerTraceback);
+    lua_insert(L, handler);
+    int status = luaL_loadbuffer(L, code.c_str(),
+                                 code.size(), "=worker");
+    if (status == 0) {
+        lua_insert(L, handler + 1);
+        status = lua_pcall(L, nargs, 1, handler);
+    } else {
+        // drop arguments, keep error message
+        lua_insert(L, handler + 1);
+        lua_settop(L, handler + 1);
+    }
+    lua_remove(L, handler);
+    return status == 0;
+}
+
+static const char* WORKER_INIT =
+    "local path, cpath = ...\n"
+    "package.path = path\n"
+    "package.cpath = cpath\n"
+    "require 'npge'\n";
+
+static const char* WORKER_CONFIG =
+    "local conf = ...\n"
+    "require 'npge.config':load(conf)\n";
+
+static std::string workerError(lua_State* L) {
+    size_t len;
+    const char* message = lua_tolstring(L, -1, &len);
+    if (!message) {
+        return "Error in worker";
+    }
+    return std::string(message, len);
+}
+
+static lua_State* newWorkerState(const std::string& path,
+                                 const std::string& cpath) {
+    lua_State* L = luaL_newstate();
+    if (!L) {
+        throw std::runtime_error("Can't create Lua state");
+    }
+    luaL_openlibs(L);
+    // npge.cpp loaded to worker does not keep threads
+    lua_pushboolean(L, 1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "npge_threads_user");
+    lua_pushlstring(L, path.c_str(), path.size());
+    lua_pushlstring(L, cpath.c_str(), cpath.size());
+    if (!workerCall(L, WORKER_INIT, 2)) {
+        std::string error = workerError(L);
+        lua_close(L);
+        throw std::runtime_error(error);
+    }
+    lua_settop(L, 0);
+    return L;
+}
+
+// reloads config only if it was changed since last job
+static void updateWorkerConfig(WorkerState& state,
+                               const std::string& config) {
+    if (state.config_ == config) {
+        return;
+    }
+    lua_State* L = state.L_;
+    lua_pushlstring(L, config.c_str(), config.size());
+    if (!workerCall(L, WORKER_CONFIG, 1)) {
+        std::string error = workerError(L);
+        lua_settop(L, 0);
+        throw std::runtime_error(error);
+    }
+    lua_settop(L, 0);
+    state.config_ = config;
+}
+
+static void runWorkerJob(lua_State* L, const std::string& code,
+                         WorkerResult& result) {
+    result.ok_ = workerCall(L, code, 0);
+    result.type_ = lua_type(L, -1);
+    result.is_integer_ = false;
+    if (!result.ok_) {
+        result.type_ = LUA_TSTRING;
+    } else if (result.type_ == LUA_TNUMBER) {
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, -1)) {
+            result.is_integer_ = true;
+            result.integer_ = lua_tointeger(L, -1);
+        }
+#endif
+        result.number_ = lua_tonumber(L, -1);
+    } else if (result.type_ == LUA_TBOOLEAN) {
+        result.number_ = lua_toboolean(L, -1);
+    } else if (result.type_ != LUA_TSTRING &&
+               result.type_ != LUA_TNIL) {
+        result.ok_ = false;
+        result.type_ = LUA_TSTRING;
+        lua_pushliteral(L, "Worker returned non-primitive");
+    }
+    if (!result.ok_) {
+        result.text_ = workerError(L);
+    } else if (result.type_ == LUA_TSTRING) {
+        size_t len;
+        const char* text = lua_tolstring(L, -1, &len);
+        result.text_.assign(text, len);
+    }
+    lua_settop(L, 0);
+    // free objects of the job, e.g. BlockSets from refs
+    lua_gc(L, LUA_GCCOLLECT, 0);
+}
+
+// task index is index of worker state,
+// jobs are taken from shared counter
+class WorkersTask : public ParallelTask {
+public:
+    WorkersTask(const Strings& codes, const std::string& config,
+                const std::string& path,
+                const std::string& cpath,
+                WorkerResults& results):
+        codes_(codes), config_(config),
+        path_(path), cpath_(cpath),
+        results_(results), next_() {
+    }
+
+    void run(int index) {
+        WorkerState& state = worker_states_[index];
+        while (true) {
+            int job = next_.increment() - 1;
+            if (job >= codes_.size()) {
+                break;
+            }
+            if (!state.L_) {
+                state.L_ = newWorkerState(path_, cpath_);
+            }
+            updateWorkerConfig(state, config_);
+            runWorkerJob(state.L_, codes_[job], results_[job]);
+        }
+    }
+
+private:
+    const Strings& codes_;
+    const std::string& config_;
+    const std::string& path_;
+    const std::string& cpath_;
+    WorkerResults& results_;
+    AtomicCounter next_; // zeroed by value-initialization
+};
+
+static void runWorkers(WorkerResults& results,
+                       const Strings& codes,
+                       const std::string& config,
+                       const std::string& path,
+                       const std::string& cpath,
+                       int workers) {
+    int n = codes.size();
+    workers = std::max(1, std::min(workers, n));
+    if (worker_states_.size() < workers) {
+        worker_states_.resize(workers);
+    }
+    results.resize(n);
+    WorkersTask task(codes, config, path, cpath, results);
+    parallelFor(task, workers, workers);
+}
+
+static std::string getPackageField(lua_State* L,
+                                   const char* name) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, name);
+    size_t len;
+    const char* value = lua_tolstring(L, -1, &len);
+    std::string result(value ? value : "", len);
+    lua_pop(L, 2);
+    return result;
+}
+
+// runWorkers({codes}, config, workers)
+// Each code is run in a Lua state of worker with npge
+// loaded and config (result of config:save()) applied.
+// Returns results of codes (nils are skipped) and errors
+// or nothing if the states are used by other thread.
+static int lua_runWorkers(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    size_t config_len;
+    const char* config_str = luaL_checklstring(L, 2,
+                                               &config_len);
+    int workers = luaL_checkinteger(L, 3);
+    int n = npge_rawlen(L, 1);
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 1, i + 1);
+        luaL_argcheck(L, lua_isstring(L, -1), 1,
+                      "codes must be strings");
+        lua_pop(L, 1);
+    }
+    Strings codes(n);
+    for (int i = 0; i < n; i++) {
+        lua_rawgeti(L, 1, i + 1);
+        size_t len;
+        const char* code = lua_tolstring(L, -1, &len);
+        codes[i].assign(code, len);
+        lua_pop(L, 1);
+    }
+    std::string config(config_str, config_len);
+    std::string path = getPackageField(L, "path");
+    std::string cpath = getPackageField(L, "cpath");
+    if (!acquireWorkerStates()) {
+        return 0;
+    }
+    WorkerResults results;
+    try {
+        runWorkers(results, codes, config, path, cpath,
+                   workers);
+    } catch (...) {
+        releaseWorkerStates();
+        throw;
+    }
+    releaseWorkerStates();
+    lua_newtable(L); // results
+    lua_newtable(L); // errors
+    for (int i = 0; i < n; i++) {
+        const WorkerResult& result = results[i];
+        int table = result.ok_ ? -2 : -1;
+        if (result.type_ == LUA_TNIL) {
+            continue;
+        } else if (result.is_integer_) {
+            lua_pushinteger(L, result.integer_);
+        } else if (result.type_ == LUA_TNUMBER) {
+            lua_pushnumber(L, result.number_);
+        } else if (result.type_ == LUA_TBOOLEAN) {
+            lua_pushboolean(L, result.number_ != 0);
+        } else {
+            lua_pushlstring(L, result.text_.c_str(),
+                            result.text_.size());
+        }
+        int len = npge_rawlen(L, table - 1);
+        lua_rawseti(L, table - 1, len + 1);
+    }
+    return 2;
+}
+
 static const luaL_Reg string_functions[] = {
     {"toAtgcn", lua_toAtgcn},
     {"toAtgcnAndGap", lua_toAtgcnAndGap},
     {"complement", lua_complement},
+    {"stringKernels", lua_stringKernels},
+    {"setStringKernels", lua_setStringKernels},
+    {"compactRows", lua_compactRows},
+    {"setCompactRows", lua_setCompactRows},
     {"unwindRow", lua_unwindRow},
     {"identity", lua_identity},
     {"consensus", lua_consensus},
@@ -1656,6 +2594,7 @@ static const luaL_Reg string_functions[] = {
     {"patch", lua_ShortForm_patch},
     {"goodColumns", lua_good_columns},
     {"goodSlices", lua_goodSlices},
+    {"runWorkers", wrap<lua_runWorkers>::func},
     {NULL, NULL}
 };
 
@@ -1669,7 +2608,44 @@ static const luaL_Reg alignment_functions[] = {
 };
 
 extern "C" {
+int lua_releaseThreads(lua_State *L) {
+    bool last;
+    {
+        SpinLockGuard lock(worker_states_lock_);
+        npge_users_ -= 1;
+        last = (npge_users_ == 0);
+    }
+    if (last) {
+        closeWorkerStates();
+    }
+    releaseThreads();
+    return 0;
+}
+
+// threads and Lua states of workers are stopped
+// when the last Lua state is closed
+static void registerThreadsUser(lua_State *L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, "npge_threads_user");
+    bool worker = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (worker) {
+        return;
+    }
+    retainThreads();
+    {
+        SpinLockGuard lock(worker_states_lock_);
+        npge_users_ += 1;
+    }
+    lua_newuserdata(L, 1);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, lua_releaseThreads);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, "npge_threads_user");
+}
+
 int luaopen_npge_cpp(lua_State *L) {
+    registerThreadsUser(L);
     lua_newtable(L); // npge.cpp
     lua_newtable(L); // npge.cpp.model
     registerType(L, "Sequence", "npge_Sequence",
@@ -1685,12 +2661,20 @@ int luaopen_npge_cpp(lua_State *L) {
                  "npge_BlockSet_cache", wrap<lua_BlockSet>::func,
                  BlockSet_mt, BlockSet_methods);
     registerBlockSetFromRef(L);
+    registerType(L, "BlockSetBuilder", "npge_BlockSetBuilder",
+                 "npge_BlockSetBuilder_cache",
+                 wrap<lua_BlockSetBuilder>::func,
+                 BlockSetBuilder_mt, BlockSetBuilder_methods);
     lua_setfield(L, -2, "model");
     //
     lua_newtable(L); // npge.cpp.block
     npge_setfuncs(L, block_functions);
     lua_setfield(L, -2, "block");
     //
+    lua_newtable(L); // npge.cpp.algo
+    npge_setfuncs(L, algo_functions);
+    lua_setfield(L, -2, "algo");
+    //
     lua_newtable(L); // npge.cpp.func
     npge_setfuncs(L, string_functions);
     lua_setfield(L, -2, "func");
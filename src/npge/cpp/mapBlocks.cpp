@@ -0,0 +1,85 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "cast.hpp"
+
+namespace lnpge {
+
+BlockKernel::~BlockKernel() {
+}
+
+GoodSubblocksKernel::GoodSubblocksKernel(
+        const GoodSubblocksParams& params):
+    params_(params) {
+}
+
+void GoodSubblocksKernel::apply(Blocks& result,
+                                const BlockPtr& block) const {
+    goodSubblocks(result, block, params_);
+}
+
+void RefineKernel::apply(Blocks& result,
+                         const BlockPtr& block) const {
+    result.push_back(block->refine());
+}
+
+// cost of processing a block, see Workers.blockCost
+static double blockCost(const Block& block) {
+    return double(block.size()) * block.length();
+}
+
+// the most costly blocks are processed first
+class MapBlocksTask : public ParallelTask {
+public:
+    MapBlocksTask(const BlockSet& bs, const BlockKernel& kernel,
+                  std::vector<Blocks>& results):
+        bs_(bs), kernel_(kernel), results_(results) {
+        int n = bs.size();
+        std::vector<double> costs(n);
+        for (int i = 0; i < n; i++) {
+            costs[i] = blockCost(*bs.blockAt(i));
+        }
+        largestFirst(order_, costs);
+    }
+
+    void run(int index) {
+        int block_index = order_[index];
+        kernel_.apply(results_[block_index],
+                      bs_.blockAt(block_index));
+    }
+
+private:
+    const BlockSet& bs_;
+    const BlockKernel& kernel_;
+    std::vector<Blocks>& results_;
+    Ints order_;
+};
+
+BlockSetPtr mapBlocks(const BlockSet& bs,
+                      const BlockKernel& kernel, int workers) {
+    int n = bs.size();
+    std::vector<Blocks> results(n);
+    MapBlocksTask task(bs, kernel, results);
+    parallelFor(task, n, workers);
+    Blocks blocks;
+    Strings names;
+    BOOST_FOREACH (const Blocks& new_blocks, results) {
+        BOOST_FOREACH (const BlockPtr& block, new_blocks) {
+            blocks.push_back(block);
+            names.push_back(TO_S(blocks.size()));
+        }
+    }
+    Sequences sequences;
+    for (int i = 0; i < bs.sequencesNumber(); i++) {
+        sequences.push_back(bs.sequenceAt(i));
+    }
+    return BlockSet::make(sequences, blocks, names, workers);
+}
+
+}
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <iterator>
 #include <map>
+#include <new>
 #include <set>
 #include <boost/foreach.hpp>
 #include <boost/scoped_array.hpp>
@@ -17,6 +18,8 @@
 #include <boost/algorithm/string/classification.hpp>
 
 #include "npge.hpp"
+#include "pool.hpp"
+#include "sync.hpp"
 #include "throw_assert.hpp"
 #include "cast.hpp"
 
@@ -24,8 +27,6 @@ namespace lnpge {
 
 typedef boost::scoped_array<char> Buffer;
 
-typedef std::vector<int> Ints;
-
 static void range(Ints& ints, int n) {
     ints.resize(n);
     for (int i = 0; i < n; i++) {
@@ -58,7 +59,7 @@ It binarySearch(It begin, It end, const V& v) {
 struct SeqRecordLess {
     bool operator()(const SeqRecord& a,
                     const SeqRecord& b) const {
-        return a.sequence_->name() < b.sequence_->name();
+        return *a.sequence_ < *b.sequence_;
     }
 
     bool operator()(const SeqRecord& a,
@@ -77,33 +78,6 @@ struct BlockRecordBlockLess {
                     const BlockRecord& b) const {
         return *(b.block_) < *(a.block_);
     }
-
-    bool operator()(const BlockRecord& a,
-                    const BlockPtr& b) const {
-        return *b < *(a.block_);
-    }
-
-    bool operator()(const BlockPtr& a,
-                    const BlockRecord& b) const {
-        return *(b.block_) < *a;
-    }
-};
-
-struct BlockRecordNameLess {
-    bool operator()(const BlockRecord& a,
-                    const BlockRecord& b) const {
-        return a.name_ < b.name_;
-    }
-
-    bool operator()(const BlockRecord& a,
-                    const std::string& b) const {
-        return a.name_ < b;
-    }
-
-    bool operator()(const std::string& a,
-                    const BlockRecord& b) const {
-        return a < b.name_;
-    }
 };
 
 struct IndexedFragmentLess {
@@ -177,7 +151,111 @@ struct FragmentLess {
 
 ///////
 
-Sequence::Sequence() {
+Sequence::Sequence():
+    id_(-1), circular_(false), genome_id_(-1) {
+}
+
+struct GenomeChrCirc {
+    GenomeChrCirc(const std::string& name):
+        circ(false) {
+        using namespace boost::algorithm;
+        Strings parts;
+        split(parts, name, is_any_of("&"));
+        if (parts.size() == 3 && !parts[0].empty() &&
+                !parts[1].empty() && !parts[2].empty()) {
+            genome.swap(parts[0]);
+            chr.swap(parts[1]);
+            circ = (parts[2][0] == 'c');
+        }
+    }
+
+    std::string genome, chr;
+    bool circ;
+};
+
+struct NameRecord {
+    int id_;
+    int users_; // number of sequences
+};
+
+typedef std::map<std::string, NameRecord> Name2Id;
+
+// Registry of sequence names or genomes.
+// Shared by all Lua states of the process.
+// A name is removed with its last sequence and its id is
+// reused, so the registry is as large as live sequences.
+struct Registry {
+    Name2Id name2id_;
+    Ints free_ids_;
+    int next_id_;
+};
+
+// registries are never destroyed, because sequences can
+// outlive static variables at exit
+static Registry* names_ = 0;
+static Registry* genomes_ = 0;
+static SpinLock registry_lock_ = NPGE_SPIN_LOCK_INIT;
+
+// called under the lock
+static Registry& getRegistry(Registry*& registry) {
+    if (!registry) {
+        registry = new Registry;
+        registry->next_id_ = 0;
+    }
+    return *registry;
+}
+
+static int registerName(Registry*& registry0,
+                        const std::string& name) {
+    if (name.empty()) {
+        return -1;
+    }
+    SpinLockGuard lock(registry_lock_);
+    Registry& registry = getRegistry(registry0);
+    Name2Id::iterator it = registry.name2id_.find(name);
+    if (it != registry.name2id_.end()) {
+        it->second.users_ += 1;
+        return it->second.id_;
+    }
+    NameRecord record;
+    if (!registry.free_ids_.empty()) {
+        record.id_ = registry.free_ids_.back();
+        registry.free_ids_.pop_back();
+    } else {
+        record.id_ = registry.next_id_;
+        registry.next_id_ += 1;
+    }
+    record.users_ = 1;
+    registry.name2id_[name] = record;
+    return record.id_;
+}
+
+static void releaseName(Registry*& registry0,
+                        const std::string& name) {
+    if (name.empty()) {
+        return;
+    }
+    SpinLockGuard lock(registry_lock_);
+    Registry& registry = getRegistry(registry0);
+    Name2Id::iterator it = registry.name2id_.find(name);
+    // called from destructor, must not throw
+    if (it == registry.name2id_.end()) {
+        return;
+    }
+    it->second.users_ -= 1;
+    if (it->second.users_ == 0) {
+        registry.free_ids_.push_back(it->second.id_);
+        registry.name2id_.erase(it);
+    }
+}
+
+Sequence::~Sequence() {
+    if (id_ != -1) {
+        releaseName(names_, name_);
+    }
+    if (genome_id_ != -1) {
+        releaseName(genomes_, genome_);
+    }
 }
 
 SequencePtr Sequence::make(const std::string& name,
@@ -191,6 +269,12 @@ SequencePtr Sequence::make(const std::string& name,
     seq->text_.assign(b.get(), b_len);
     seq->name_ = name;
     seq->description_ = description;
+    GenomeChrCirc gcc(name);
+    seq->genome_.swap(gcc.genome);
+    seq->chromosome_.swap(gcc.chr);
+    seq->circular_ = gcc.circ;
+    seq->id_ = registerName(names_, name);
+    seq->genome_id_ = registerName(genomes_, seq->genome_);
     return SequencePtr(seq);
 }
 
@@ -198,57 +282,55 @@ const std::string& Sequence::name() const {
     return name_;
 }
 
+int Sequence::id() const {
+    return id_;
+}
+
 const std::string& Sequence::description() const {
     return description_;
 }
 
-struct GenomeChrCirc {
-    GenomeChrCirc(const std::string& name):
-        circ(false) {
-        using namespace boost::algorithm;
-        Strings parts;
-        split(parts, name, is_any_of("&"));
-        if (parts.size() == 3 && !parts[0].empty() &&
-                !parts[1].empty() && !parts[2].empty()) {
-            genome.swap(parts[0]);
-            chr.swap(parts[1]);
-            circ = (parts[2][0] == 'c');
-        }
-    }
-
-    std::string genome, chr;
-    bool circ;
-};
-
-std::string Sequence::genome() const {
-    GenomeChrCirc gcc(name());
-    return gcc.genome;
+const std::string& Sequence::genome() const {
+    return genome_;
 }
 
-std::string Sequence::chromosome() const {
-    GenomeChrCirc gcc(name());
-    return gcc.chr;
+const std::string& Sequence::chromosome() const {
+    return chromosome_;
 }
 
 bool Sequence::circular() const {
-    GenomeChrCirc gcc(name());
-    return gcc.circ;
+    return circular_;
+}
+
+int Sequence::genomeId() const {
+    return genome_id_;
 }
 
 int Sequence::length() const {
     return text_.length();
 }
 
-const std::string& Sequence::text() const {
-    return text_;
+std::string Sequence::text() const {
+    return sub(0, length() - 1);
 }
 
 std::string Sequence::sub(int min, int max) const {
+    int len = max - min + 1;
+    Buffer b(new char[len]);
+    sub(b.get(), min, max, 1);
+    return std::string(b.get(), len);
+}
+
+void Sequence::sub(char* dst, int min, int max, int ori) const {
     ASSERT_LTE(0, min);
     ASSERT_LTE(min, max);
     ASSERT_LT(max, length());
     int len = max - min + 1;
-    return text_.substr(min, len);
+    if (ori == 1) {
+        text_.unpack(dst, min, len);
+    } else {
+        text_.unpackComplement(dst, min, len);
+    }
 }
 
 std::string Sequence::tostring() const {
@@ -257,10 +339,65 @@ std::string Sequence::tostring() const {
 }
 
 bool Sequence::operator==(const Sequence& other) const {
-    return name() == other.name();
+    return id_ == other.id_;
+}
+
+bool Sequence::operator<(const Sequence& other) const {
+    if (id_ == other.id_) {
+        return false;
+    }
+    return name() < other.name();
+}
+
+Fragment::Fragment():
+    parts_(0) {
+}
+
+static Pool fragments_pool_ = NPGE_POOL_INIT;
+static NPGE_THREAD_LOCAL PoolCache fragments_cache_ =
+    NPGE_POOL_CACHE_INIT;
+
+void* Fragment::operator new(std::size_t size) {
+    if (size != sizeof(Fragment)) {
+        return ::operator new(size);
+    }
+    return poolAllocate(fragments_pool_, fragments_cache_,
+                        size);
+}
+
+void Fragment::operator delete(void* p, std::size_t size) {
+    if (size != sizeof(Fragment)) {
+        ::operator delete(p);
+    } else {
+        poolDeallocate(fragments_pool_, fragments_cache_, p);
+    }
 }
 
-Fragment::Fragment() {
+static Pool parts_pool_ = NPGE_POOL_INIT;
+static NPGE_THREAD_LOCAL PoolCache parts_cache_ =
+    NPGE_POOL_CACHE_INIT;
+
+Fragment::~Fragment() {
+    if (parts_) {
+        parts_->~TwoFragments();
+        poolDeallocate(parts_pool_, parts_cache_, parts_);
+    }
+}
+
+static TwoFragments makeParts(const Fragment& fragment) {
+    const SequencePtr& seq = fragment.sequence();
+    int start = fragment.start();
+    int stop = fragment.stop();
+    int last = seq->length() - 1;
+    if (fragment.ori() == 1) {
+        return TwoFragments(
+                Fragment::make(seq, start, last, 1),
+                Fragment::make(seq, 0, stop, 1));
+    } else {
+        return TwoFragments(
+                Fragment::make(seq, start, 0, -1),
+                Fragment::make(seq, last, stop, -1));
+    }
 }
 
 FragmentPtr Fragment::make(SequencePtr sequence,
@@ -276,9 +413,13 @@ FragmentPtr Fragment::make(SequencePtr sequence,
     fragment->start_ = start;
     fragment->stop_ = (stop + 1) * ori;
     FragmentPtr fr(fragment);
-    if (!sequence->circular()) {
-        ASSERT_MSG(!fragment->parted(), "Found parted "
+    if (fragment->parted()) {
+        ASSERT_MSG(sequence->circular(), "Found parted "
                    "fragment on linear sequence");
+        TwoFragments parts = makeParts(*fragment);
+        void* chunk = poolAllocate(parts_pool_, parts_cache_,
+                                   sizeof(TwoFragments));
+        fragment->parts_ = new (chunk) TwoFragments(parts);
     }
     return fr;
 }
@@ -327,51 +468,47 @@ std::string Fragment::tostring() const {
     return text;
 }
 
-TwoFragments Fragment::parts() const {
+const TwoFragments& Fragment::parts() const {
     ASSERT_TRUE(parted());
-    const SequencePtr& seq = sequence();
-    int last = seq->length() - 1;
-    if (ori() == 1) {
-        return TwoFragments(
-                Fragment::make(seq, start(), last, 1),
-                Fragment::make(seq, 0, stop(), 1));
-    } else {
-        return TwoFragments(
-                Fragment::make(seq, start(), 0, -1),
-                Fragment::make(seq, last, stop(), -1));
-    }
+    return *parts_;
 }
 
 std::string Fragment::text() const {
+    int len = length();
+    Buffer b(new char[len]);
+    const SequencePtr& seq = sequence();
     if (!parted()) {
         int min = fragmentMin(*this);
         int max = fragmentMax(*this);
-        std::string text = sequence()->sub(min, max);
+        seq->sub(b.get(), min, max, ori());
+    } else {
+        // same as parts(), without making fragments
+        int last = seq->length() - 1;
+        int first_len;
         if (ori() == 1) {
-            return text;
+            seq->sub(b.get(), start(), last, 1);
+            first_len = last - start() + 1;
+            seq->sub(b.get() + first_len, 0, stop(), 1);
         } else {
-            Buffer b(new char[text.size()]);
-            int l = complement(b.get(), text.c_str(),
-                    text.size());
-            return std::string(b.get(), l);
+            seq->sub(b.get(), 0, start(), -1);
+            first_len = start() + 1;
+            seq->sub(b.get() + first_len, stop(), last, -1);
         }
-    } else {
-        TwoFragments two = parts();
-        return two.first->text() + two.second->text();
     }
+    return std::string(b.get(), len);
 }
 
 int Fragment::common(const Fragment& other) const {
-    if (sequence()->name() != other.sequence()->name()) {
+    if (!(*sequence() == *other.sequence())) {
         return 0;
     }
     if (parted()) {
-        TwoFragments two = parts();
+        const TwoFragments& two = parts();
         return two.first->common(other) +
                two.second->common(other);
     }
     if (other.parted()) {
-        TwoFragments two = other.parts();
+        const TwoFragments& two = other.parts();
         return common(*two.first) + common(*two.second);
     }
     int self_min = fragmentMin(*this);
@@ -389,24 +526,23 @@ int Fragment::common(const Fragment& other) const {
 }
 
 bool Fragment::operator==(const Fragment& other) const {
-    typedef boost::tuple<int, int, const std::string&> T;
-    T t1(start_, stop_, sequence()->name());
-    T t2(other.start_, other.stop_, other.sequence()->name());
-    return t1 == t2;
+    return start_ == other.start_ && stop_ == other.stop_ &&
+           *sequence() == *other.sequence();
 }
 
 bool Fragment::operator<(const Fragment& other) const {
-    typedef boost::tuple<
-        const std::string&, int, int, int, bool
-    > T;
+    const Sequence& self_seq = *sequence();
+    const Sequence& other_seq = *other.sequence();
+    if (!(self_seq == other_seq)) {
+        return self_seq < other_seq;
+    }
+    typedef boost::tuple<int, int, int, bool> T;
     int self_min = fragmentMin(*this);
     int self_max = fragmentMax(*this);
     int other_min = fragmentMin(other);
     int other_max = fragmentMax(other);
-    T t1(sequence()->name(),
-            self_min, self_max, ori(), parted());
-    T t2(other.sequence()->name(),
-            other_min, other_max, other.ori(), other.parted());
+    T t1(self_min, self_max, ori(), parted());
+    T t2(other_min, other_max, other.ori(), other.parted());
     return t1 < t2;
 }
 
@@ -421,6 +557,25 @@ int fragmentMax(const Fragment& fragment) {
 Block::Block() {
 }
 
+static Pool blocks_pool_ = NPGE_POOL_INIT;
+static NPGE_THREAD_LOCAL PoolCache blocks_cache_ =
+    NPGE_POOL_CACHE_INIT;
+
+void* Block::operator new(std::size_t size) {
+    if (size != sizeof(Block)) {
+        return ::operator new(size);
+    }
+    return poolAllocate(blocks_pool_, blocks_cache_, size);
+}
+
+void Block::operator delete(void* p, std::size_t size) {
+    if (size != sizeof(Block)) {
+        ::operator delete(p);
+    } else {
+        poolDeallocate(blocks_pool_, blocks_cache_, p);
+    }
+}
+
 BlockPtr Block::make(const Fragments& fragments) {
     ASSERT_MSG(fragments.size(), "Empty block is not allowed");
     Block* block = new Block;
@@ -441,6 +596,7 @@ BlockPtr Block::make(const Fragments& fragments) {
         row.resize(max_len, '-');
     }
     block->length_ = max_len;
+    block->setGaps();
     return b;
 }
 
@@ -467,6 +623,12 @@ BlockPtr Block::make(const Fragments& fragments,
         ASSERT_EQ(memcmp(b.get(), fr_str.c_str(), len2), 0);
 #endif
     }
+    return fromRows(fragments, rows);
+}
+
+BlockPtr Block::fromRows(const Fragments& fragments,
+                         Strings& rows) {
+    int n = fragments.size();
     // sort
     Ints indexes;
     range(indexes, n);
@@ -489,20 +651,51 @@ BlockPtr Block::make(const Fragments& fragments,
     BOOST_FOREACH (const std::string& row, block->rows_) {
         ASSERT_EQ(row.length(), block->length_);
     }
+    block->setGaps();
     return b;
 }
 
+void Block::setGaps() {
+    int n = size();
+    gaps_.resize(n);
+    for (int i = 0; i < n; i++) {
+        findGapRuns(gaps_[i], rows_[i].c_str(), length_);
+    }
+    hash_ = hashCombine(n, length_);
+    for (int i = 0; i < n; i++) {
+        const Fragment& f = *fragments_[i];
+        hash_ = hashCombine(hash_, f.sequence()->id());
+        hash_ = hashCombine(hash_, f.start());
+        hash_ = hashCombine(hash_, f.stop());
+        hash_ = hashCombine(hash_, f.ori());
+        BOOST_FOREACH (const GapRun& run, gaps_[i]) {
+            hash_ = hashCombine(hash_, run.start_);
+            hash_ = hashCombine(hash_, run.length_);
+        }
+    }
+    if (compactRows()) {
+        Strings().swap(rows_);
+    }
+}
+
 bool Block::operator==(const Block& other) const {
     if (size() != other.size() || length() != other.length()) {
         return false;
     }
+    if (hash_ != other.hash_) {
+        return false;
+    }
     int n = size();
     for (int i = 0; i < n; i++) {
         const FragmentPtr& f1 = fragments_[i];
         const FragmentPtr& f2 = other.fragments_[i];
-        const std::string& t1 = rows_[i];
-        const std::string& t2 = other.rows_[i];
-        if (!(*f1 == *f2) || t1 != t2) {
+        if (!(*f1 == *f2) || gaps_[i] != other.gaps_[i]) {
+            return false;
+        }
+        // sequences with equal names can have different
+        // texts, equal gaps give equal rows otherwise
+        if (f1->sequence() != f2->sequence() &&
+                f1->text() != f2->text()) {
             return false;
         }
     }
@@ -520,11 +713,12 @@ bool Block::operator<(const Block& other) const {
         return false;
     }
     int n = size();
+    std::string buffer1, buffer2;
     for (int i = 0; i < n; i++) {
         const FragmentPtr& f1 = fragments_[i];
         const FragmentPtr& f2 = other.fragments_[i];
-        const std::string& r1 = rows_[i];
-        const std::string& r2 = other.rows_[i];
+        const std::string& r1 = row(i, buffer1);
+        const std::string& r2 = other.row(i, buffer2);
         typedef const Fragment& A;
         typedef const std::string& B;
         typedef boost::tuple<A, B> T;
@@ -552,15 +746,96 @@ const Fragments& Block::fragments() const {
     return fragments_;
 }
 
-const std::string& Block::text(
-        const FragmentPtr& fragment) const {
+const Strings& Block::rows(Strings& buffer) const {
+    if (!rows_.empty()) {
+        return rows_;
+    }
+    int n = size();
+    buffer.resize(n);
+    for (int i = 0; i < n; i++) {
+        row(i, buffer[i]);
+    }
+    return buffer;
+}
+
+const std::string& Block::row(int index,
+                              std::string& buffer) const {
+    if (!rows_.empty()) {
+        return rows_[index];
+    }
+    std::string text = fragments_[index]->text();
+    buffer.resize(length_);
+    applyGapRuns(&buffer[0], gaps_[index], text.c_str(),
+                 length_);
+    return buffer;
+}
+
+int Block::fragmentIndex(const FragmentPtr& fragment) const {
     Fragments::const_iterator it = binarySearch(
             fragments_.begin(), fragments_.end(),
             fragment, FragmentLess());
     ASSERT_MSG(it != fragments_.end(),
                "Fragment not in block");
-    int index = std::distance(fragments_.begin(), it);
-    return rows_[index];
+    return std::distance(fragments_.begin(), it);
+}
+
+const std::string& Block::text(const FragmentPtr& fragment,
+                               std::string& buffer) const {
+    return row(fragmentIndex(fragment), buffer);
+}
+
+void Block::rowsPointers(std::vector<const char*>& rows,
+                         Strings& buffers) const {
+    int n = size();
+    rows.resize(n);
+    buffers.resize(rows_.empty() ? n : 0);
+    for (int i = 0; i < n; i++) {
+        if (rows_.empty()) {
+            rows[i] = row(i, buffers[i]).c_str();
+        } else {
+            rows[i] = rows_[i].c_str();
+        }
+    }
+}
+
+double Block::identity() const {
+    std::vector<const char*> rows;
+    Strings buffers;
+    rowsPointers(rows, buffers);
+    return lnpge::identity(&rows[0], size(), 0, length_ - 1);
+}
+
+std::string Block::consensus() const {
+    std::vector<const char*> rows;
+    Strings buffers;
+    rowsPointers(rows, buffers);
+    Buffer cons(new char[length_]);
+    lnpge::consensus(cons.get(), &rows[0], size(), length_);
+    return std::string(cons.get(), length_);
+}
+
+Scores Block::goodColumns(int min_identity,
+                          int min_length) const {
+    std::vector<const char*> rows;
+    Strings buffers;
+    rowsPointers(rows, buffers);
+    return lnpge::goodColumns(&rows[0], size(), length_,
+                              min_identity, min_length);
+}
+
+BlockPtr Block::refine() const {
+    Strings rows;
+    if (rows_.empty()) {
+        this->rows(rows);
+    } else {
+        rows = rows_;
+    }
+    refineAlignment(rows);
+    return fromRows(fragments_, rows);
+}
+
+Hash Block::hash() const {
+    return hash_;
 }
 
 std::string Block::tostring() const {
@@ -572,75 +847,87 @@ int Block::fragment2block(const FragmentPtr& fragment,
                           int fragmentpos) const {
     ASSERT_LTE(0, fragmentpos);
     ASSERT_LT(fragmentpos, fragment->length());
-    const std::string& t_str = text(fragment);
-    const char* t = t_str.c_str();
-    int nongaps_before = 0;
-    int result = 0;
-    int l = length();
-    for (int bp = 0; bp < l; bp++) {
-        if (t[bp] != '-') {
-            if (nongaps_before == fragmentpos) {
-                result = bp;
-                break;
-            }
-            nongaps_before += 1;
-        }
-    }
-    return result;
-}
-
-static int countNongaps(const char* t, int length) {
-    int nongaps_before = 0;
-    for (int bp = 0; bp < length; bp++) {
-        if (t[bp] != '-') {
-            nongaps_before += 1;
-        }
-    }
-    return nongaps_before;
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    return gapRunsFragment2block(runs, fragmentpos);
 }
 
 int Block::block2fragment(const FragmentPtr& fragment,
                           int blockpos) const {
     ASSERT_LTE(0, blockpos);
     ASSERT_LT(blockpos, length());
-    const std::string& t_str = text(fragment);
-    const char* t = t_str.c_str();
-    if (t[blockpos] == '-') {
-        return -1;
-    } else {
-        return countNongaps(t, blockpos);
-    }
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    return gapRunsBlock2fragment(runs, blockpos);
 }
 
 int Block::block2left(const FragmentPtr& fragment,
                       int blockpos) const {
     ASSERT_LTE(0, blockpos);
     ASSERT_LT(blockpos, length());
-    const std::string& t_str = text(fragment);
-    const char* t = t_str.c_str();
-    if (t[blockpos] == '-') {
-        return countNongaps(t, blockpos) - 1;
-    } else {
-        return countNongaps(t, blockpos);
-    }
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    return gapRunsBlock2left(runs, blockpos);
 }
 
 int Block::block2right(const FragmentPtr& fragment,
                        int blockpos) const {
     ASSERT_LTE(0, blockpos);
     ASSERT_LT(blockpos, length());
-    const std::string& t_str = text(fragment);
-    const char* t = t_str.c_str();
-    if (t[blockpos] == '-') {
-        int nongaps = countNongaps(t, blockpos);
-        if (nongaps < fragment->length()) {
-            return nongaps;
-        } else {
-            return -1;
-        }
-    } else {
-        return countNongaps(t, blockpos);
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    return gapRunsBlock2right(runs, blockpos,
+                              fragment->length());
+}
+
+Ints Block::fragment2block(const FragmentPtr& fragment,
+                           const Ints& positions) const {
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    Ints result(positions.size());
+    for (int i = 0; i < positions.size(); i++) {
+        int fragmentpos = positions[i];
+        ASSERT_LTE(0, fragmentpos);
+        ASSERT_LT(fragmentpos, fragment->length());
+        result[i] = gapRunsFragment2block(runs, fragmentpos);
+    }
+    return result;
+}
+
+Ints Block::block2fragment(const FragmentPtr& fragment,
+                           const Ints& positions) const {
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    Ints result(positions.size());
+    for (int i = 0; i < positions.size(); i++) {
+        int blockpos = positions[i];
+        ASSERT_LTE(0, blockpos);
+        ASSERT_LT(blockpos, length());
+        result[i] = gapRunsBlock2fragment(runs, blockpos);
+    }
+    return result;
+}
+
+Ints Block::block2left(const FragmentPtr& fragment,
+                       const Ints& positions) const {
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    Ints result(positions.size());
+    for (int i = 0; i < positions.size(); i++) {
+        int blockpos = positions[i];
+        ASSERT_LTE(0, blockpos);
+        ASSERT_LT(blockpos, length());
+        result[i] = gapRunsBlock2left(runs, blockpos);
+    }
+    return result;
+}
+
+Ints Block::block2right(const FragmentPtr& fragment,
+                        const Ints& positions) const {
+    const GapRuns& runs = gaps_[fragmentIndex(fragment)];
+    int fragment_length = fragment->length();
+    Ints result(positions.size());
+    for (int i = 0; i < positions.size(); i++) {
+        int blockpos = positions[i];
+        ASSERT_LTE(0, blockpos);
+        ASSERT_LT(blockpos, length());
+        result[i] = gapRunsBlock2right(runs, blockpos,
+                                       fragment_length);
     }
+    return result;
 }
 
 ///////
@@ -707,7 +994,7 @@ static void collectFragments(SeqRecords& seq_records,
                 flist.push_back(f);
                 blist.push_back(b);
             } else {
-                TwoFragments two = f->parts();
+                const TwoFragments& two = f->parts();
                 flist.push_back(two.first);
                 flist.push_back(two.second);
                 blist.push_back(b);
@@ -722,55 +1009,23 @@ static void collectFragments(SeqRecords& seq_records,
     }
 }
 
-static void sortFragments(SeqRecords& seq_records) {
-    BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
-        Fragments& fragments = seq_record.fragments_;
-        Blocks& blocks = seq_record.blocks_;
-        int n = fragments.size();
-        Ints indexes;
-        range(indexes, n);
-        std::sort(indexes.begin(), indexes.end(),
-                  IndexedFragmentLess(fragments));
-        Fragments new_fragments(n);
-        Blocks new_blocks(n);
-        for (int j = 0; j < n; j++) {
-            int index = indexes[j];
-            new_fragments[j] = fragments[index];
-            new_blocks[j] = blocks[index];
-        }
-        fragments.swap(new_fragments);
-        blocks.swap(new_blocks);
-    }
-}
-
-// TODO can be omitted if the blockset is a partition
-static void findInternalOverlaps(SeqRecords& seq_records) {
-    BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
-        seq_record.internal_overlaps_ = false;
-        Fragments& fragments = seq_record.fragments_;
-        int n = fragments.size();
-        for (int j = 1; j < n; j++) {
-            const FragmentPtr& prev = fragments[j - 1];
-            const FragmentPtr& curr = fragments[j];
-            int prev_max = fragmentMax(*prev);
-            int curr_max = fragmentMax(*curr);
-            if (prev_max >= curr_max) {
-                seq_record.internal_overlaps_ = true;
-                break;
-            }
-        }
-    }
-}
-
-static void makeSegmentTrees(SeqRecords& seq_records) {
-    BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
-        if (!seq_record.internal_overlaps_) {
-            continue;
-        }
-        const Fragments& fragments = seq_record.fragments_;
-        Coordinates& segment_tree = seq_record.segment_tree_;
-        makeSegmentTree(segment_tree, fragments);
+static void sortFragments(SeqRecord& seq_record) {
+    Fragments& fragments = seq_record.fragments_;
+    Blocks& blocks = seq_record.blocks_;
+    int n = fragments.size();
+    Ints indexes;
+    range(indexes, n);
+    std::sort(indexes.begin(), indexes.end(),
+              IndexedFragmentLess(fragments));
+    Fragments new_fragments(n);
+    Blocks new_blocks(n);
+    for (int j = 0; j < n; j++) {
+        int index = indexes[j];
+        new_fragments[j] = fragments[index];
+        new_blocks[j] = blocks[index];
     }
+    fragments.swap(new_fragments);
+    blocks.swap(new_blocks);
 }
 
 static void sortParts(Fragments& parts, Fragments& parents) {
@@ -791,22 +1046,27 @@ static void sortParts(Fragments& parts, Fragments& parents) {
 }
 
 // TODO can be omitted if the blockset is a partition
-static void findSameParts(SeqRecords& seq_records) {
-    BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
-        seq_record.same_parts_ = false;
-        Fragments& fragments = seq_record.fragments_;
-        int n = fragments.size();
-        for (int j = 1; j < n; j++) {
-            const FragmentPtr& prev = fragments[j - 1];
-            const FragmentPtr& curr = fragments[j];
-            if (*prev == *curr) {
-                seq_record.same_parts_ = true;
-                break;
-            }
+static void findSameParts(SeqRecord& seq_record) {
+    seq_record.same_parts_ = false;
+    Fragments& fragments = seq_record.fragments_;
+    int n = fragments.size();
+    for (int j = 1; j < n; j++) {
+        const FragmentPtr& prev = fragments[j - 1];
+        const FragmentPtr& curr = fragments[j];
+        if (*prev == *curr) {
+            seq_record.same_parts_ = true;
+            break;
         }
     }
 }
 
+// sorts fragments, makes index, finds same parts
+static void prepareRecord(SeqRecord& seq_record) {
+    sortFragments(seq_record);
+    seq_record.index_.assign(seq_record.fragments_);
+    findSameParts(seq_record);
+}
+
 static void makeOrigMap(SeqRecords& seq_records,
                         const BlockRecords& records) {
     BOOST_FOREACH (const BlockRecord& br, records) {
@@ -825,29 +1085,67 @@ static void makeOrigMap(SeqRecords& seq_records,
     }
 }
 
-static void sortOrigMap(SeqRecords& seq_records) {
-    BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
-        if (!seq_record.same_parts_) {
-            ASSERT_EQ(seq_record.orig_fragments_.size(), 0);
-            continue;
-        }
-        Fragments& flist = seq_record.orig_fragments_;
-        Blocks& blist = seq_record.orig_blocks_;
-        // sort
-        int n = flist.size();
-        Ints indexes;
-        range(indexes, n);
-        std::sort(indexes.begin(), indexes.end(),
-                  IndexedFragmentLess(flist));
-        Fragments new_flist(n);
-        Blocks new_blist(n);
+static void sortOrigMap(SeqRecord& seq_record) {
+    if (!seq_record.same_parts_) {
+        ASSERT_EQ(seq_record.orig_fragments_.size(), 0);
+        return;
+    }
+    Fragments& flist = seq_record.orig_fragments_;
+    Blocks& blist = seq_record.orig_blocks_;
+    // sort
+    int n = flist.size();
+    Ints indexes;
+    range(indexes, n);
+    std::sort(indexes.begin(), indexes.end(),
+              IndexedFragmentLess(flist));
+    Fragments new_flist(n);
+    Blocks new_blist(n);
+    for (int i = 0; i < n; i++) {
+        int index = indexes[i];
+        new_flist[i] = flist[index];
+        new_blist[i] = blist[index];
+    }
+    flist.swap(new_flist);
+    blist.swap(new_blist);
+}
+
+typedef void (*RecordFunction)(SeqRecord&);
+
+// applies function to records, largest records first
+class RecordsTask : public ParallelTask {
+public:
+    RecordsTask(SeqRecords& seq_records, RecordFunction f):
+        seq_records_(seq_records), f_(f) {
+        int n = seq_records.size();
+        std::vector<double> sizes(n);
         for (int i = 0; i < n; i++) {
-            int index = indexes[i];
-            new_flist[i] = flist[index];
-            new_blist[i] = blist[index];
+            sizes[i] = seq_records[i].fragments_.size();
+        }
+        largestFirst(order_, sizes);
+    }
+
+    void run(int index) {
+        f_(seq_records_[order_[index]]);
+    }
+
+private:
+    SeqRecords& seq_records_;
+    RecordFunction f_;
+    Ints order_;
+};
+
+// BlockSet::make uses threads if there are more fragments
+const int MIN_PARALLEL_FRAGMENTS = 4096;
+
+static void forEachRecord(SeqRecords& seq_records,
+                          RecordFunction f, int workers) {
+    if (workers > 1 && seq_records.size() > 1) {
+        RecordsTask task(seq_records, f);
+        parallelFor(task, seq_records.size(), workers);
+    } else {
+        BOOST_FOREACH (SeqRecord& seq_record, seq_records) {
+            f(seq_record);
         }
-        flist.swap(new_flist);
-        blist.swap(new_blist);
     }
 }
 
@@ -875,9 +1173,47 @@ static bool testPartition(const SeqRecords& seq_records) {
 BlockSet::BlockSet() {
 }
 
+// does not depend on order of blocks
+static Hash blocksHash(const BlockRecords& records) {
+    Hash sum = 0;
+    BOOST_FOREACH (const BlockRecord& record, records) {
+        sum += hashCombine(0, record.block_->hash());
+    }
+    return hashCombine(records.size(), sum);
+}
+
+static void makeHashIndexes(HashIndex& name_index,
+                            HashIndex& block_index,
+                            const BlockRecords& records,
+                            bool check_names = true) {
+    int n = records.size();
+    Hashes name_hashes(n), block_hashes(n);
+    for (int i = 0; i < n; i++) {
+        name_hashes[i] = hashString(records[i].name_);
+        block_hashes[i] = records[i].block_->hash();
+    }
+    name_index.assign(name_hashes);
+    block_index.assign(block_hashes);
+#ifndef NPGE_NO_ASSERTS
+    // names are unique
+    for (int i = 0; check_names && i < n; i++) {
+        const std::string& name = records[i].name_;
+        Hash hash = name_hashes[i];
+        int slot;
+        int j = name_index.first(hash, slot);
+        for (; j != -1; j = name_index.next(hash, slot)) {
+            if (j != i) {
+                ASSERT_NE(records[j].name_, name);
+            }
+        }
+    }
+#endif
+}
+
 BlockSetPtr BlockSet::make(const Sequences& sequences,
                            const Blocks& blocks,
-                           const Strings& names) {
+                           const Strings& names,
+                           int workers) {
     BlockSet* bs = new BlockSet;
     BlockSetPtr ptr(bs);
     prepareSequences(bs->seq_records_, sequences);
@@ -888,32 +1224,136 @@ BlockSetPtr BlockSet::make(const Sequences& sequences,
         bs->block2name_[i].name_ = names[i];
         ASSERT_GT(names[i].size(), 0);
     }
-    bs->name2block_ = bs->block2name_;
     std::sort(bs->block2name_.begin(), bs->block2name_.end(),
               BlockRecordBlockLess());
-    std::sort(bs->name2block_.begin(), bs->name2block_.end(),
-              BlockRecordNameLess());
-    for (int i = 1; i < bs->name2block_.size(); i++) {
-        ASSERT_LT(bs->name2block_[i - 1].name_,
-                  bs->name2block_[i].name_);
-    }
+    makeHashIndexes(bs->name_index_, bs->block_index_,
+                    bs->block2name_);
+    bs->hash_ = blocksHash(bs->block2name_);
     //
     collectFragments(bs->seq_records_, bs->block2name_,
                      bs->parts_, bs->parent_of_parts_);
-    sortFragments(bs->seq_records_);
-    findInternalOverlaps(bs->seq_records_);
-    makeSegmentTrees(bs->seq_records_);
+    int nfragments = 0;
+    BOOST_FOREACH (const SeqRecord& sr, bs->seq_records_) {
+        nfragments += sr.fragments_.size();
+    }
+    if (nfragments < MIN_PARALLEL_FRAGMENTS) {
+        workers = 1;
+    }
+    forEachRecord(bs->seq_records_, prepareRecord, workers);
     sortParts(bs->parts_, bs->parent_of_parts_);
     //
-    findSameParts(bs->seq_records_);
     makeOrigMap(bs->seq_records_, bs->block2name_);
-    sortOrigMap(bs->seq_records_);
+    forEachRecord(bs->seq_records_, sortOrigMap, workers);
     //
     bs->isPartition_ = testPartition(bs->seq_records_);
     //
     return ptr;
 }
 
+typedef std::vector<const Block*> BlockPointers;
+
+static bool isSelected(const BlockPointers& sorted,
+                       const BlockPtr& block) {
+    return std::binary_search(sorted.begin(), sorted.end(),
+                              block.get());
+}
+
+// copies fragments of selected blocks from sorted record
+static void filterRecord(SeqRecord& dst, const SeqRecord& src,
+                         const BlockPointers& selected) {
+    dst.sequence_ = src.sequence_;
+    for (int i = 0; i < src.fragments_.size(); i++) {
+        if (isSelected(selected, src.blocks_[i])) {
+            dst.fragments_.push_back(src.fragments_[i]);
+            dst.blocks_.push_back(src.blocks_[i]);
+        }
+    }
+    dst.index_.assign(dst.fragments_);
+    findSameParts(dst);
+    if (!dst.same_parts_) {
+        return;
+    }
+    // same_parts_ of dst implies same_parts_ of src
+    const Fragments& flist = src.orig_fragments_;
+    const Blocks& blist = src.orig_blocks_;
+    for (int i = 0; i < flist.size(); i++) {
+        if (isSelected(selected, blist[i])) {
+            dst.orig_fragments_.push_back(flist[i]);
+            dst.orig_blocks_.push_back(blist[i]);
+        }
+    }
+}
+
+BlockSetPtr BlockSet::subset(const Strings& names) const {
+    Ints indexes;
+    BOOST_FOREACH (const std::string& name, names) {
+        int index = nameIndex(name);
+        // blocks must belong to this blockset
+        ASSERT_MSG(index != -1, ("No block " + name).c_str());
+        indexes.push_back(index);
+    }
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()),
+                  indexes.end());
+    BlockPointers selected;
+    BOOST_FOREACH (int index, indexes) {
+        selected.push_back(block2name_[index].block_.get());
+    }
+    std::sort(selected.begin(), selected.end());
+    selected.erase(std::unique(selected.begin(),
+                               selected.end()),
+                   selected.end());
+    BlockSet* bs = new BlockSet;
+    BlockSetPtr ptr(bs);
+    // block2name_ is sorted, subsequence is sorted too
+    BOOST_FOREACH (const BlockRecord& record, block2name_) {
+        if (isSelected(selected, record.block_)) {
+            bs->block2name_.push_back(record);
+        }
+    }
+    if (bs->block2name_.size() != indexes.size()) {
+        // some block is selected under some of its names,
+        // its fragments can not be filtered by pointer
+        Sequences sequences;
+        BOOST_FOREACH (const SeqRecord& sr, seq_records_) {
+            sequences.push_back(sr.sequence_);
+        }
+        Blocks blocks;
+        Strings new_names;
+        BOOST_FOREACH (int index, indexes) {
+            blocks.push_back(block2name_[index].block_);
+            new_names.push_back(block2name_[index].name_);
+        }
+        return make(sequences, blocks, new_names);
+    }
+    bool check_names = false;
+    makeHashIndexes(bs->name_index_, bs->block_index_,
+                    bs->block2name_, check_names);
+    bs->hash_ = blocksHash(bs->block2name_);
+    //
+    int nseqs = seq_records_.size();
+    bs->seq_records_.resize(nseqs);
+    for (int i = 0; i < nseqs; i++) {
+        filterRecord(bs->seq_records_[i], seq_records_[i],
+                     selected);
+    }
+    BOOST_FOREACH (const BlockRecord& br, bs->block2name_) {
+        const BlockPtr& b = br.block_;
+        BOOST_FOREACH (const FragmentPtr& f, b->fragments()) {
+            if (f->parted()) {
+                const TwoFragments& two = f->parts();
+                bs->parts_.push_back(two.first);
+                bs->parts_.push_back(two.second);
+                bs->parent_of_parts_.push_back(f);
+                bs->parent_of_parts_.push_back(f);
+            }
+        }
+    }
+    sortParts(bs->parts_, bs->parent_of_parts_);
+    bs->isPartition_ = testPartition(bs->seq_records_);
+    return ptr;
+}
+
 bool BlockSet::sameSequences(const BlockSet& other) const {
     if (seq_records_.size() != other.seq_records_.size()) {
         return false;
@@ -922,7 +1362,7 @@ bool BlockSet::sameSequences(const BlockSet& other) const {
     for (int i = 0; i < n; i++) {
         const SequencePtr& a = seq_records_[i].sequence_;
         const SequencePtr& b = other.seq_records_[i].sequence_;
-        if (a->name() != b->name()) {
+        if (!(*a == *b)) {
             return false;
         }
     }
@@ -982,6 +1422,9 @@ const char* BlockSet::cmp(const BlockSet& other) const {
 }
 
 bool BlockSet::operator==(const BlockSet& other) const {
+    if (hash_ != other.hash_) {
+        return false;
+    }
     const char* r = cmp(other);
     return r == 0;
 }
@@ -990,6 +1433,10 @@ int BlockSet::size() const {
     return block2name_.size();
 }
 
+Hash BlockSet::hash() const {
+    return hash_;
+}
+
 bool BlockSet::isPartition() const {
     return isPartition_;
 }
@@ -1003,35 +1450,51 @@ const std::string& BlockSet::nameAt(int i) const {
 }
 
 BlockPtr BlockSet::blockByName(const std::string& n) const {
-    typedef BlockRecords::const_iterator It;
-    It it = binarySearch(name2block_.begin(),
-                         name2block_.end(),
-                         n, BlockRecordNameLess());
-    if (it != name2block_.end()) {
-        return it->block_;
-    } else {
+    int i = nameIndex(n);
+    if (i == -1) {
         return BlockPtr();
     }
+    return block2name_[i].block_;
+}
+
+// index in block2name_ or -1
+int BlockSet::nameIndex(const std::string& n) const {
+    Hash hash = hashString(n);
+    int slot;
+    int i = name_index_.first(hash, slot);
+    for (; i != -1; i = name_index_.next(hash, slot)) {
+        if (block2name_[i].name_ == n) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// index in block2name_ or -1
+int BlockSet::blockIndex(const BlockPtr& b) const {
+    Hash hash = b->hash();
+    int slot;
+    int i = block_index_.first(hash, slot);
+    for (; i != -1; i = block_index_.next(hash, slot)) {
+        const BlockPtr& block = block2name_[i].block_;
+        if (block == b || *block == *b) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 std::string BlockSet::nameByBlock(const BlockPtr& b) const {
-    typedef BlockRecords::const_iterator It;
-    It it = binarySearch(block2name_.begin(),
-                         block2name_.end(),
-                         b, BlockRecordBlockLess());
-    if (it != block2name_.end()) {
-        return it->name_;
+    int i = blockIndex(b);
+    if (i != -1) {
+        return block2name_[i].name_;
     } else {
         return "";
     }
 }
 
 bool BlockSet::hasBlock(const BlockPtr& b) const {
-    typedef BlockRecords::const_iterator It;
-    It it = binarySearch(block2name_.begin(),
-                         block2name_.end(),
-                         b, BlockRecordBlockLess());
-    return it != block2name_.end();
+    return blockIndex(b) != -1;
 }
 
 const Fragments& BlockSet::parts(
@@ -1082,7 +1545,7 @@ BlockPtr BlockSet::blockByFragment(
         return sit->orig_blocks_[index2];
     }
     if (fragment->parted()) {
-        TwoFragments two = fragment->parts();
+        const TwoFragments& two = fragment->parts();
         return blockByFragment(two.first);
     }
     const Fragments& fragments = sit->fragments_;
@@ -1148,76 +1611,55 @@ void sortAndUnique(const BlockSet* self, Fragments& ff) {
     ff.erase(std::unique(ff.begin(), ff.end()), ff.end());
 }
 
-// TODO can lose results if same_parts_
-// because parentOrFragment is ambiguous
-Fragments BlockSet::overlapping(
+void BlockSet::overlappingParts(
+        Fragments& result, Ints& indexes,
         const FragmentPtr& fragment) const {
     if (fragment->parted()) {
-        TwoFragments two = fragment->parts();
-        Fragments o1 = overlapping(two.first);
-        Fragments o2 = overlapping(two.second);
-        Fragments result;
-        BOOST_FOREACH (const FragmentPtr& f, o1) {
-            result.push_back(f);
-        }
-        BOOST_FOREACH (const FragmentPtr& f, o2) {
-            result.push_back(f);
-        }
-        sortAndUnique(this, result);
-        return result;
+        const TwoFragments& two = fragment->parts();
+        overlappingParts(result, indexes, two.first);
+        overlappingParts(result, indexes, two.second);
+        return;
     }
     const SequencePtr& sequence = fragment->sequence();
     CSit sit = rawFindSeq(sequence->name(), seq_records_);
     if (sit == seq_records_.end()) {
-        return Fragments();
+        return;
     }
-    const Fragments& fragments = sit->fragments_;
-    if (fragments.empty()) {
-        return Fragments();
-    }
-    if (sit->internal_overlaps_) {
-        // use segment tree
-        Fragments result;
-        const Coordinates& segment_tree = sit->segment_tree_;
-        findOverlapping(result, segment_tree,
-                        fragments, fragment);
-        sortAndUnique(this, result);
-        return result;
-    }
-    const Fragments::const_iterator it = std::upper_bound(
-            fragments.begin(), fragments.end(),
-            fragment, FragmentLess());
-    int index2;
-    if (it == fragments.end()) {
-        index2 = fragments.size();
-    } else {
-        index2 = std::distance(fragments.begin(), it);
+    indexes.clear();
+    sit->index_.find(indexes, fragmentMin(*fragment),
+                     fragmentMax(*fragment));
+    BOOST_FOREACH (int index, indexes) {
+        result.push_back(sit->fragments_[index]);
     }
+}
+
+// TODO can lose results if same_parts_
+// because parentOrFragment is ambiguous
+Fragments BlockSet::overlapping(
+        const FragmentPtr& fragment) const {
     Fragments result;
-    for (int j = index2; j < fragments.size(); j++) {
-        const FragmentPtr& f = fragments[j];
-        if (f->common(*fragment)) {
-            result.push_back(f);
-        } else {
-            break;
-        }
-    }
-    for (int j = index2 - 1; j >= 0; j--) {
-        const FragmentPtr& f = fragments[j];
-        if (f->common(*fragment)) {
-            result.push_back(f);
-        } else {
-            break;
-        }
-    }
+    Ints indexes;
+    overlappingParts(result, indexes, fragment);
     sortAndUnique(this, result);
     return result;
 }
 
+std::vector<Fragments> BlockSet::overlapping(
+        const Fragments& fragments) const {
+    int n = fragments.size();
+    std::vector<Fragments> result(n);
+    Ints indexes;
+    for (int i = 0; i < n; i++) {
+        overlappingParts(result[i], indexes, fragments[i]);
+        sortAndUnique(this, result[i]);
+    }
+    return result;
+}
+
 FragmentPtr BlockSet::next(const FragmentPtr& fragment) const {
     const SequencePtr& sequence = fragment->sequence();
     if (fragment->parted()) {
-        TwoFragments two = fragment->parts();
+        const TwoFragments& two = fragment->parts();
         FragmentPtr part = two.first;
         if (*two.second < *two.first) {
             part = two.second;
@@ -1244,7 +1686,7 @@ FragmentPtr BlockSet::next(const FragmentPtr& fragment) const {
 FragmentPtr BlockSet::prev(const FragmentPtr& fragment) const {
     const SequencePtr& sequence = fragment->sequence();
     if (fragment->parted()) {
-        TwoFragments two = fragment->parts();
+        const TwoFragments& two = fragment->parts();
         FragmentPtr part = two.first;
         if (*two.first < *two.second) {
             part = two.second;
@@ -0,0 +1,245 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <map>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+#include "cast.hpp"
+
+namespace lnpge {
+
+// common part of fragment of bs1 and fragment of bs2
+struct MulPiece {
+    BlockPtr block1_;
+    BlockPtr block2_;
+    FragmentPtr f1_;
+    const Fragment* f2_;
+    // first_ > last_ if the piece goes through position 0
+    int first_;
+    int last_;
+};
+
+typedef std::vector<MulPiece> MulPieces;
+
+// by fragments, then by position
+struct MulPieceFragmentLess {
+    bool operator()(const MulPiece& a,
+                    const MulPiece& b) const {
+        if (a.f1_ != b.f1_) {
+            return a.f1_ < b.f1_;
+        }
+        if (a.f2_ != b.f2_) {
+            return a.f2_ < b.f2_;
+        }
+        return a.first_ < b.first_;
+    }
+};
+
+// by blocks
+struct MulPieceBlockLess {
+    bool operator()(const MulPiece& a,
+                    const MulPiece& b) const {
+        if (a.block1_ != b.block1_) {
+            return a.block1_ < b.block1_;
+        }
+        return a.block2_ < b.block2_;
+    }
+};
+
+// Both blocksets are partitions, so parts of a sequence
+// are sorted, do not overlap and cover the sequence.
+static void intersectParts(MulPieces& pieces,
+                           const BlockSet& bs1,
+                           const BlockSet& bs2,
+                           const SequencePtr& sequence) {
+    const Fragments& parts1 = bs1.parts(sequence);
+    const Fragments& parts2 = bs2.parts(sequence);
+    int i = 0, j = 0;
+    while (i < parts1.size() && j < parts2.size()) {
+        const FragmentPtr& p1 = parts1[i];
+        const FragmentPtr& p2 = parts2[j];
+        int max1 = fragmentMax(*p1);
+        int max2 = fragmentMax(*p2);
+        int first = std::max(fragmentMin(*p1),
+                             fragmentMin(*p2));
+        int last = std::min(max1, max2);
+        if (first <= last) {
+            MulPiece piece;
+            piece.f1_ = bs1.parentOrFragment(p1);
+            const FragmentPtr& f2 = bs2.parentOrFragment(p2);
+            piece.f2_ = f2.get();
+            piece.block1_ = bs1.blockByFragment(piece.f1_);
+            piece.block2_ = bs2.blockByFragment(f2);
+            piece.first_ = first;
+            piece.last_ = last;
+            pieces.push_back(piece);
+        }
+        if (max1 < max2) {
+            i += 1;
+        } else {
+            j += 1;
+        }
+    }
+}
+
+// joins the pieces of a parted fragment at position 0
+static void joinPieces(MulPieces& pieces) {
+    std::sort(pieces.begin(), pieces.end(),
+              MulPieceFragmentLess());
+    MulPieces result;
+    int n = pieces.size();
+    int i = 0;
+    while (i < n) {
+        int j = i;
+        while (j < n && pieces[j].f1_ == pieces[i].f1_ &&
+                pieces[j].f2_ == pieces[i].f2_) {
+            j += 1;
+        }
+        MulPiece& head = pieces[i];
+        MulPiece& tail = pieces[j - 1];
+        int length = head.f1_->sequence()->length();
+        int from = i;
+        if (head.f1_->parted() && j - i >= 2 &&
+                head.first_ == 0 && tail.last_ == length - 1) {
+            tail.last_ = head.last_;
+            from = i + 1;
+        }
+        for (int k = from; k < j; k++) {
+            result.push_back(pieces[k]);
+        }
+        i = j;
+    }
+    pieces.swap(result);
+}
+
+static FragmentPtr pieceFragment(const MulPiece& piece) {
+    const SequencePtr& seq = piece.f1_->sequence();
+    if (piece.f1_->ori() == 1) {
+        return Fragment::make(seq, piece.first_,
+                              piece.last_, 1);
+    } else {
+        return Fragment::make(seq, piece.last_,
+                              piece.first_, -1);
+    }
+}
+
+static int seqToFragment(const Fragment& f, int pos) {
+    int diff = (pos - f.start()) * f.ori();
+    if (diff < 0) {
+        // parted fragment
+        diff += f.sequence()->length();
+    }
+    return diff;
+}
+
+// rows of block1, built once if rows are compact
+typedef std::map<const Fragment*, std::string> RowsMap;
+
+// slices rows of block1 and removes gap-only columns
+static BlockPtr makeBlock(MulPieces::const_iterator begin,
+                          MulPieces::const_iterator end,
+                          RowsMap& rows_map) {
+    const Block& block1 = *begin->block1_;
+    Fragments fragments;
+    Ints starts, stops;
+    std::vector<const std::string*> sources;
+    int min_col = block1.length(), max_col = -1;
+    for (MulPieces::const_iterator it = begin;
+            it != end; ++it) {
+        const FragmentPtr& f1 = it->f1_;
+        FragmentPtr piece = pieceFragment(*it);
+        int first = seqToFragment(*f1, piece->start());
+        int last = first + piece->length() - 1;
+        int start = block1.fragment2block(f1, first);
+        int stop = block1.fragment2block(f1, last);
+        fragments.push_back(piece);
+        starts.push_back(start);
+        stops.push_back(stop);
+        std::string& row = rows_map[f1.get()];
+        if (row.empty()) {
+            std::string buffer;
+            row = block1.text(f1, buffer);
+        }
+        sources.push_back(&row);
+        min_col = std::min(min_col, start);
+        max_col = std::max(max_col, stop);
+    }
+    int n = fragments.size();
+    int length = max_col - min_col + 1;
+    Strings rows(n, std::string(length, '-'));
+    std::vector<bool> used(length, false);
+    for (int i = 0; i < n; i++) {
+        const std::string& source = *sources[i];
+        for (int bp = starts[i]; bp <= stops[i]; bp++) {
+            char c = source[bp];
+            if (c != '-') {
+                rows[i][bp - min_col] = c;
+                used[bp - min_col] = true;
+            }
+        }
+    }
+    // remove gap-only columns
+    BOOST_FOREACH (std::string& row, rows) {
+        int dst = 0;
+        for (int bp = 0; bp < length; bp++) {
+            if (used[bp]) {
+                row[dst] = row[bp];
+                dst += 1;
+            }
+        }
+        row.resize(dst);
+    }
+    CStrings crows(n);
+    for (int i = 0; i < n; i++) {
+        crows[i] = CString(rows[i].c_str(), rows[i].size());
+    }
+    return Block::make(fragments, crows);
+}
+
+BlockSetPtr multiply(const BlockSet& bs1,
+                     const BlockSet& bs2, int workers) {
+    ASSERT_MSG(bs1.isPartition(), "blockset is not partition");
+    ASSERT_MSG(bs2.isPartition(), "blockset is not partition");
+    ASSERT_MSG(bs1.sameSequences(bs2),
+               "blocksets use different sets of sequences");
+    MulPieces pieces;
+    Sequences sequences;
+    for (int i = 0; i < bs1.sequencesNumber(); i++) {
+        const SequencePtr& sequence = bs1.sequenceAt(i);
+        sequences.push_back(sequence);
+        intersectParts(pieces, bs1, bs2, sequence);
+    }
+    joinPieces(pieces);
+    std::stable_sort(pieces.begin(), pieces.end(),
+                     MulPieceBlockLess());
+    Blocks blocks;
+    Strings names;
+    RowsMap rows_map;
+    MulPieces::const_iterator begin = pieces.begin();
+    while (begin != pieces.end()) {
+        MulPieces::const_iterator end = begin;
+        while (end != pieces.end() &&
+                end->block1_ == begin->block1_ &&
+                end->block2_ == begin->block2_) {
+            ++end;
+        }
+        if (begin != pieces.begin() &&
+                (begin - 1)->block1_ != begin->block1_) {
+            rows_map.clear();
+        }
+        blocks.push_back(makeBlock(begin, end, rows_map));
+        names.push_back(TO_S(blocks.size()));
+        begin = end;
+    }
+    BlockSetPtr result = BlockSet::make(sequences, blocks,
+                                        names, workers);
+    ASSERT_TRUE(result->isPartition());
+    return result;
+}
+
+}
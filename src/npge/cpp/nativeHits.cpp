@@ -0,0 +1,497 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+#include "cast.hpp"
+
+namespace lnpge {
+
+NativeHitsParams::NativeHitsParams():
+    word_length_(15), window_(10), max_occurrences_(100),
+    band_(16), x_drop_(40), chunk_(1000),
+    match_(2), mismatch_(-3), gap_(-5),
+    min_length_(100), same_(false) {
+}
+
+static int baseCode(char c) {
+    switch (c) {
+    case 'A':
+        return 0;
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    }
+    return -1;
+}
+
+// k-mer is canonical if it is not greater than its
+// complement. k is odd, so a k-mer is never equal to it
+struct Minimizer {
+    Hash hash_; // of canonical k-mer
+    int pos_; // start of k-mer
+    int ori_; // 1 if the k-mer itself is canonical
+};
+
+typedef std::vector<Minimizer> Minimizers;
+
+// minimizers of windows of p.window_ k-mers, k-mers with
+// letters other than ATGC are skipped
+static void findMinimizers(Minimizers& result,
+                           const std::string& text,
+                           const NativeHitsParams& p) {
+    int k = p.word_length_;
+    Hash mask = (Hash(1) << (2 * k)) - 1;
+    Hash forward = 0, reverse = 0;
+    int valid = 0; // length of current run of ATGC
+    int last_pos = -1;
+    std::deque<Minimizer> window; // increasing hashes
+    for (int i = 0; i < text.size(); i++) {
+        int c = baseCode(text[i]);
+        if (c == -1) {
+            valid = 0;
+            window.clear();
+            continue;
+        }
+        forward = ((forward << 2) | c) & mask;
+        reverse = (reverse >> 2) | (Hash(3 - c) << (2 * k - 2));
+        valid += 1;
+        if (valid < k) {
+            continue;
+        }
+        Minimizer m;
+        m.pos_ = i - k + 1;
+        m.ori_ = (forward < reverse) ? 1 : -1;
+        m.hash_ = hashCombine(0, std::min(forward, reverse));
+        while (!window.empty() &&
+                window.back().hash_ >= m.hash_) {
+            window.pop_back();
+        }
+        window.push_back(m);
+        while (window.front().pos_ <= m.pos_ - p.window_) {
+            window.pop_front();
+        }
+        if (valid >= k + p.window_ - 1 &&
+                window.front().pos_ != last_pos) {
+            result.push_back(window.front());
+            last_pos = window.front().pos_;
+        }
+    }
+}
+
+struct BankKmer {
+    int seq_;
+    int pos_;
+    int ori_;
+};
+
+typedef std::vector<BankKmer> BankKmers;
+
+struct Bank {
+    Sequences sequences_;
+    Strings texts_;
+    Strings complements_; // reverse complements of texts_
+    BankKmers kmers_;
+    HashIndex index_; // hashes of kmers_
+};
+
+static void makeBank(Bank& bank, const BlockSet& bs,
+                     const NativeHitsParams& p) {
+    Hashes hashes;
+    for (int i = 0; i < bs.sequencesNumber(); i++) {
+        const SequencePtr& seq = bs.sequenceAt(i);
+        bank.sequences_.push_back(seq);
+        bank.texts_.push_back(seq->text());
+        int length = seq->length();
+        std::string complement(length, ' ');
+        if (length > 0) {
+            seq->sub(&complement[0], 0, length - 1, -1);
+        }
+        bank.complements_.push_back(complement);
+        Minimizers minimizers;
+        findMinimizers(minimizers, bank.texts_.back(), p);
+        BOOST_FOREACH (const Minimizer& m, minimizers) {
+            BankKmer kmer;
+            kmer.seq_ = i;
+            kmer.pos_ = m.pos_;
+            kmer.ori_ = m.ori_;
+            bank.kmers_.push_back(kmer);
+            hashes.push_back(m.hash_);
+        }
+    }
+    bank.index_.assign(hashes);
+}
+
+// aligned part of two texts, q is query, t is target
+struct Alignment {
+    int q_start_, q_stop_; // including stop
+    int t_start_, t_stop_;
+    std::string q_row_, t_row_;
+};
+
+const int DEAD = -1000000000;
+
+enum {
+    FROM_DIAG,
+    FROM_Q, // letter of q against gap
+    FROM_T // letter of t against gap
+};
+
+// Extends alignment from q[qpos] and t[tpos] in direction
+// dir (1 or -1) using DP in band around the diagonal,
+// which stops when score falls x_drop below the maximum.
+// DP is run in chunks of chunk_ rows of bounded memory,
+// next chunk starts from the best cell of previous one.
+// Appends aligned letters in order of extension.
+static void extend(std::string& q_row, std::string& t_row,
+                   int& q_used, int& t_used,
+                   const std::string& q, int qpos,
+                   const std::string& t, int tpos, int dir,
+                   const NativeHitsParams& p) {
+    q_used = 0;
+    t_used = 0;
+    int B = p.band_;
+    int W = 2 * B + 1;
+    std::vector<char> from;
+    Ints prev(W), curr(W);
+    while (true) {
+        int q0 = qpos + dir * q_used;
+        int t0 = tpos + dir * t_used;
+        int q_left = (dir == 1) ? (q.size() - q0) : (q0 + 1);
+        int t_left = (dir == 1) ? (t.size() - t0) : (t0 + 1);
+        int rows = std::min(p.chunk_, q_left);
+        from.assign((rows + 1) * W, FROM_DIAG);
+        // row 0: only gaps in q
+        int best = 0, best_i = 0, best_j = 0;
+        for (int d = 0; d < W; d++) {
+            int j = d - B;
+            if (j >= 0 && j <= t_left &&
+                    j * p.gap_ >= -p.x_drop_) {
+                prev[d] = j * p.gap_;
+                from[d] = FROM_T;
+            } else {
+                prev[d] = DEAD;
+            }
+        }
+        bool alive = true;
+        int i = 1;
+        for (; i <= rows && alive; i++) {
+            alive = false;
+            char qc = q[q0 + dir * (i - 1)];
+            for (int d = 0; d < W; d++) {
+                int j = i + d - B;
+                curr[d] = DEAD;
+                if (j < 0 || j > t_left) {
+                    continue;
+                }
+                int score = DEAD;
+                char f = FROM_DIAG;
+                if (j > 0 && prev[d] != DEAD) {
+                    char tc = t[t0 + dir * (j - 1)];
+                    bool same = (qc == tc && qc != 'N');
+                    score = prev[d] +
+                            (same ? p.match_ : p.mismatch_);
+                }
+                // (i - 1, j) is d + 1 in previous row
+                if (d + 1 < W && prev[d + 1] != DEAD &&
+                        prev[d + 1] + p.gap_ > score) {
+                    score = prev[d + 1] + p.gap_;
+                    f = FROM_Q;
+                }
+                // (i, j - 1) is d - 1 in this row
+                if (d > 0 && curr[d - 1] != DEAD &&
+                        curr[d - 1] + p.gap_ > score) {
+                    score = curr[d - 1] + p.gap_;
+                    f = FROM_T;
+                }
+                if (score == DEAD || score < best - p.x_drop_) {
+                    continue;
+                }
+                curr[d] = score;
+                from[i * W + d] = f;
+                alive = true;
+                if (score > best) {
+                    best = score;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+            prev.swap(curr);
+        }
+        // traceback from the best cell
+        std::string q_part, t_part;
+        int ti = best_i, tj = best_j;
+        while (ti > 0 || tj > 0) {
+            char f = from[ti * W + (tj - ti + B)];
+            if (f == FROM_DIAG) {
+                q_part += q[q0 + dir * (ti - 1)];
+                t_part += t[t0 + dir * (tj - 1)];
+                ti -= 1;
+                tj -= 1;
+            } else if (f == FROM_Q) {
+                q_part += q[q0 + dir * (ti - 1)];
+                t_part += '-';
+                ti -= 1;
+            } else {
+                q_part += '-';
+                t_part += t[t0 + dir * (tj - 1)];
+                tj -= 1;
+            }
+        }
+        std::reverse(q_part.begin(), q_part.end());
+        std::reverse(t_part.begin(), t_part.end());
+        q_row += q_part;
+        t_row += t_part;
+        q_used += best_i;
+        t_used += best_j;
+        // continue if the chunk was not stopped by x_drop
+        bool chunk_full = alive && rows == p.chunk_;
+        if (!chunk_full || best_i == 0) {
+            break;
+        }
+    }
+}
+
+// seed is q[qpos, qpos + k) == t[tpos, tpos + k)
+static void extendSeed(Alignment& a,
+                       const std::string& q, int qpos,
+                       const std::string& t, int tpos,
+                       const NativeHitsParams& p) {
+    int k = p.word_length_;
+    std::string q_left, t_left;
+    int q_left_used, t_left_used;
+    extend(q_left, t_left, q_left_used, t_left_used,
+           q, qpos - 1, t, tpos - 1, -1, p);
+    std::string q_right, t_right;
+    int q_right_used, t_right_used;
+    extend(q_right, t_right, q_right_used, t_right_used,
+           q, qpos + k, t, tpos + k, 1, p);
+    a.q_start_ = qpos - q_left_used;
+    a.q_stop_ = qpos + k - 1 + q_right_used;
+    a.t_start_ = tpos - t_left_used;
+    a.t_stop_ = tpos + k - 1 + t_right_used;
+    a.q_row_.assign(q_left.rbegin(), q_left.rend());
+    a.q_row_ += q.substr(qpos, k);
+    a.q_row_ += q_right;
+    a.t_row_.assign(t_left.rbegin(), t_left.rend());
+    a.t_row_ += t.substr(tpos, k);
+    a.t_row_ += t_right;
+}
+
+// key of diagonal of bank sequence and its orientation
+static Hash diagonalKey(int seq, int ori, int diagonal) {
+    Hash key = Hash(seq) << 33;
+    key |= Hash(ori == 1) << 32;
+    key |= Hash(unsigned(diagonal));
+    return key;
+}
+
+typedef std::map<Hash, int> Coverage;
+
+class NativeHitsTask : public ParallelTask {
+public:
+    NativeHitsTask(const BlockSet& query, const Bank& bank,
+                   const NativeHitsParams& p,
+                   std::vector<Blocks>& results):
+        query_(query), bank_(bank), p_(p),
+        results_(results) {
+        int n = query.sequencesNumber();
+        std::vector<double> sizes(n);
+        for (int i = 0; i < n; i++) {
+            sizes[i] = query.sequenceAt(i)->length();
+        }
+        largestFirst(order_, sizes);
+    }
+
+    void run(int index) {
+        int iq = order_[index];
+        findHits(results_[iq], query_.sequenceAt(iq));
+    }
+
+private:
+    const BlockSet& query_;
+    const Bank& bank_;
+    const NativeHitsParams& p_;
+    std::vector<Blocks>& results_;
+    Ints order_;
+
+    // in mode same_, each pair of sequences or pair of
+    // positions of same sequence is searched once
+    bool skipSeed(const SequencePtr& q_seq, int qpos,
+                  int b, int bpos, int ori) const {
+        if (!p_.same_) {
+            return false;
+        }
+        const SequencePtr& b_seq = bank_.sequences_[b];
+        if (*q_seq == *b_seq) {
+            return ori == 1 && bpos <= qpos;
+        }
+        return *b_seq < *q_seq;
+    }
+
+    void findHits(Blocks& result, const SequencePtr& q_seq) {
+        int k = p_.word_length_;
+        std::string q = q_seq->text();
+        Minimizers minimizers;
+        findMinimizers(minimizers, q, p_);
+        Coverage coverage;
+        std::set<Hash> found;
+        BOOST_FOREACH (const Minimizer& m, minimizers) {
+            const HashIndex& index = bank_.index_;
+            int slot;
+            int occurrences = 0;
+            int i = index.first(m.hash_, slot);
+            for (; i != -1; i = index.next(m.hash_, slot)) {
+                occurrences += 1;
+            }
+            if (occurrences > p_.max_occurrences_) {
+                // repeat
+                continue;
+            }
+            i = index.first(m.hash_, slot);
+            for (; i != -1; i = index.next(m.hash_, slot)) {
+                const BankKmer& kmer = bank_.kmers_[i];
+                int ori = m.ori_ * kmer.ori_;
+                if (skipSeed(q_seq, m.pos_, kmer.seq_,
+                             kmer.pos_, ori)) {
+                    continue;
+                }
+                const std::string& t = (ori == 1) ?
+                    bank_.texts_[kmer.seq_] :
+                    bank_.complements_[kmer.seq_];
+                int tpos = (ori == 1) ? kmer.pos_ :
+                           (t.size() - kmer.pos_ - k);
+                if (t.compare(tpos, k, q, m.pos_, k) != 0) {
+                    continue;
+                }
+                Hash key = diagonalKey(kmer.seq_, ori,
+                                       tpos - m.pos_);
+                Coverage::const_iterator it =
+                    coverage.find(key);
+                if (it != coverage.end() &&
+                        it->second >= m.pos_) {
+                    continue;
+                }
+                Alignment a;
+                extendSeed(a, q, m.pos_, t, tpos, p_);
+                cover(coverage, a, kmer.seq_, ori);
+                addHit(result, found, a, q_seq,
+                       kmer.seq_, ori);
+            }
+        }
+    }
+
+    // marks diagonals around the path of the alignment
+    // covered up to the last position of query near them.
+    // Diagonal changes at gaps only, so it is done per run
+    // of columns between gaps
+    void cover(Coverage& coverage, const Alignment& a,
+               int b, int ori) const {
+        int q = a.q_start_ - 1, t = a.t_start_ - 1;
+        int length = a.q_row_.size();
+        for (int i = 0; i < length; i++) {
+            bool q_gap = (a.q_row_[i] == '-');
+            bool t_gap = (a.t_row_[i] == '-');
+            if ((q_gap || t_gap) && q >= a.q_start_) {
+                coverDiagonals(coverage, b, ori, t - q, q);
+            }
+            q += !q_gap;
+            t += !t_gap;
+        }
+        coverDiagonals(coverage, b, ori, t - q, q);
+    }
+
+    void coverDiagonals(Coverage& coverage, int b, int ori,
+                        int diagonal, int q_stop) const {
+        int min_d = diagonal - p_.band_;
+        int max_d = diagonal + p_.band_;
+        for (int d = min_d; d <= max_d; d++) {
+            int& stop = coverage[diagonalKey(b, ori, d)];
+            stop = std::max(stop, q_stop);
+        }
+    }
+
+    void addHit(Blocks& result, std::set<Hash>& found,
+                const Alignment& a, const SequencePtr& q_seq,
+                int b, int ori) const {
+        if (a.q_row_.size() < p_.min_length_) {
+            return;
+        }
+        Hash key = hashCombine(diagonalKey(b, ori, 0),
+                               a.q_start_);
+        key = hashCombine(key, a.q_stop_);
+        key = hashCombine(key, a.t_start_);
+        key = hashCombine(key, a.t_stop_);
+        if (!found.insert(key).second) {
+            return;
+        }
+        const SequencePtr& b_seq = bank_.sequences_[b];
+        FragmentPtr q_f = Fragment::make(q_seq,
+                a.q_start_, a.q_stop_, 1);
+        FragmentPtr b_f;
+        if (ori == 1) {
+            b_f = Fragment::make(b_seq,
+                    a.t_start_, a.t_stop_, 1);
+        } else {
+            int last = b_seq->length() - 1;
+            b_f = Fragment::make(b_seq,
+                    last - a.t_start_, last - a.t_stop_, -1);
+        }
+        if (p_.same_ && !(*q_f < *b_f)) {
+            return;
+        }
+        Fragments fragments;
+        fragments.push_back(q_f);
+        fragments.push_back(b_f);
+        CStrings rows;
+        rows.push_back(CString(a.q_row_.c_str(),
+                               a.q_row_.size()));
+        rows.push_back(CString(a.t_row_.c_str(),
+                               a.t_row_.size()));
+        result.push_back(Block::make(fragments, rows));
+    }
+};
+
+BlockSetPtr nativeHits(const BlockSet& query,
+                       const BlockSet& bank,
+                       const NativeHitsParams& params,
+                       int workers) {
+    ASSERT_EQ(params.word_length_ % 2, 1);
+    ASSERT_LTE(params.word_length_, 31);
+    Bank b;
+    makeBank(b, bank, params);
+    int n = query.sequencesNumber();
+    std::vector<Blocks> results(n);
+    NativeHitsTask task(query, b, params, results);
+    parallelFor(task, n, workers);
+    // sequences of bank and other sequences of query
+    Sequences sequences = b.sequences_;
+    for (int i = 0; i < n; i++) {
+        const SequencePtr& seq = query.sequenceAt(i);
+        if (!bank.sequenceByName(seq->name())) {
+            sequences.push_back(seq);
+        }
+    }
+    Blocks blocks;
+    Strings names;
+    BOOST_FOREACH (const Blocks& hits, results) {
+        BOOST_FOREACH (const BlockPtr& block, hits) {
+            blocks.push_back(block);
+            names.push_back(TO_S(blocks.size()));
+        }
+    }
+    return BlockSet::make(sequences, blocks, names, workers);
+}
+
+}
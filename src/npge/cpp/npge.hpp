@@ -9,6 +9,9 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <map>
+#include <set>
+#include <boost/cstdint.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include "intrusive_ref_counter.hpp"
 
@@ -20,12 +23,29 @@ typedef std::pair<const char*, int> CString;
 typedef std::vector<CString> CStrings;
 typedef std::vector<std::string> Strings;
 
+// complement, toAtgcn and toAtgcnAndGap use SIMD kernels
+// if supported by CPU (see stringsSimd.cpp)
 int complement(char* dst, const char* src, int length);
 
 int toAtgcn(char* dst, const char* src, int length);
 
 int toAtgcnAndGap(char* dst, const char* src, int length);
 
+int complementScalar(char* dst, const char* src, int length);
+
+int toAtgcnScalar(char* dst, const char* src, int length);
+
+int toAtgcnAndGapScalar(char* dst, const char* src,
+                        int length);
+
+// name of kernels in use: "scalar", "sse4.1" or "avx2"
+const char* stringKernels();
+
+Strings supportedStringKernels();
+
+// returns false if the kernels are not supported
+bool setStringKernels(const std::string& name);
+
 int unwindRow(char* result, const char* row, int row_size,
               const char* orig, int orig_size);
 
@@ -35,6 +55,23 @@ bool isColumnGood(const char** rows, int nrows, int i);
 // returns if i-th column is ident with gaps
 bool isColumnIdentGap(const char** rows, int nrows, int i);
 
+// bit j corresponds to column start + j
+typedef boost::uint64_t ColumnsMask;
+const int COLUMNS_IN_MASK = 64;
+
+struct ColumnMasks {
+    ColumnsMask good; // see isColumnGood
+    ColumnsMask ident_gap; // see isColumnIdentGap
+    ColumnsMask has_n;
+};
+
+// classifies columns [start, start + length) at once
+// length <= COLUMNS_IN_MASK
+ColumnMasks classifyColumns(const char** rows, int nrows,
+                            int start, int length);
+
+int countBits(ColumnsMask mask);
+
 // returns percentage and number of good columns
 double identity(const char** rows, int nrows,
                 int start, int stop);
@@ -54,11 +91,70 @@ const int MAX_COLUMN_SCORE = 100;
 
 typedef std::pair<int, int> StartStop; // start, stop
 typedef std::vector<StartStop> Coordinates;
+
+typedef std::vector<int> Ints;
+
+// hashes are valid within one process only
+typedef boost::uint64_t Hash;
+typedef std::vector<Hash> Hashes;
+
+Hash hashString(const std::string& text);
+
+Hash hashCombine(Hash seed, Hash value);
+
+class ParallelTask {
+public:
+    virtual ~ParallelTask();
+
+    virtual void run(int index) = 0;
+};
+
+// Runs task.run(i) for i in [0, n) in up to workers threads
+// including the calling one. Each thread takes next index
+// from shared counter until all are taken. The first
+// exception thrown by the task is rethrown as logic_error.
+// Define NPGE_NO_THREADS to run in the calling thread only.
+// Threads are kept between calls.
+void parallelFor(ParallelTask& task, int n, int workers);
+
+// Fills order with indexes of costs, the largest first.
+// Tasks run jobs in this order, so threads finish
+// at almost the same time.
+void largestFirst(Ints& order,
+                  const std::vector<double>& costs);
+
+// Lua states using the threads, the last release stops them
+void retainThreads();
+
+void releaseThreads();
 typedef std::vector<int> Scores;
 
 // if min_identity or min_length == 1, it is not applied
 Scores goodColumns(const char** rows, int nrows, int length,
                    int min_identity, int min_length);
+
+typedef std::vector<ColumnMasks> ColumnMasksVector;
+
+// goodColumns from masks of columns
+// masks[k] describes columns starting from k * COLUMNS_IN_MASK
+Scores scoreColumns(const ColumnMasksVector& masks,
+                    int length,
+                    int min_identity, int min_length);
+
+struct ColumnsStats {
+    int ident; // number of good columns
+    std::string consensus;
+    Scores scores; // result of goodColumns
+    // number of good columns in alignment of each row
+    // with the consensus
+    std::vector<int> rows_ident;
+};
+
+// calculates identity, consensus, goodColumns and identity
+// of each row with consensus reading rows once
+void columnsStats(ColumnsStats& stats,
+                  const char** rows, int nrows, int length,
+                  int min_identity, int min_length);
 Coordinates goodSlices(const Scores& score,
                        int frame_length, int end_length,
                        int min_identity, int min_length);
@@ -94,60 +190,128 @@ void removePureGaps(Strings& aligned);
 
 void refineAlignment(Strings& aligned);
 
+// packed text
+
+// Text of ATGCN letters stored as 2 bits per base.
+// Runs of N are stored separately.
+class PackedText {
+public:
+    PackedText();
+
+    // text must consist of letters A, T, G, C, N
+    void assign(const char* text, int length);
+
+    int length() const;
+
+    // writes letters [start, start + length) to dst
+    void unpack(char* dst, int start, int length) const;
+
+    // writes complement of letters [start, start + length)
+    void unpackComplement(char* dst, int start,
+                          int length) const;
+
+private:
+    std::vector<unsigned char> bases_;
+    Coordinates n_runs_; // sorted, not adjacent
+    int length_;
+
+    int code(int pos) const;
+};
+
 // model
 
 class Sequence;
 class Fragment;
 class Block;
 class BlockSet;
+class BlockSetBuilder;
 
 typedef boost::intrusive_ptr<const Sequence> SequencePtr;
 typedef boost::intrusive_ptr<const Fragment> FragmentPtr;
 typedef boost::intrusive_ptr<const Block> BlockPtr;
 typedef boost::intrusive_ptr<const BlockSet> BlockSetPtr;
+typedef boost::intrusive_ptr<BlockSetBuilder>
+    BlockSetBuilderPtr;
 
 typedef std::pair<FragmentPtr, FragmentPtr> TwoFragments;
 
+// Model objects are shared between threads, so reference
+// counters are atomic. NPGE_NO_THREADS selects plain
+// counters, objects must not be used by other threads then.
+#ifdef NPGE_NO_THREADS
+typedef boost::thread_unsafe_counter RefCounterPolicy;
+#else
+typedef boost::thread_safe_counter RefCounterPolicy;
+#endif
+
 typedef std::vector<SequencePtr> Sequences;
 typedef std::vector<FragmentPtr> Fragments;
 typedef std::vector<BlockPtr> Blocks;
 typedef std::vector<BlockSetPtr> BlockSets;
 
 class Sequence :
-    public boost::intrusive_ref_counter<Sequence> {
+    public boost::intrusive_ref_counter<Sequence,
+            RefCounterPolicy> {
 public:
     static SequencePtr make(const std::string& name,
                             const std::string& description,
                             const char* text, int len);
 
+    ~Sequence();
+
     const std::string& name() const;
 
+    // dense number of name, same for all sequences with
+    // this name in the process. The id of a name can be
+    // reused after all its sequences are deleted
+    int id() const;
+
     const std::string& description() const;
 
-    std::string genome() const;
+    // parsed from name in Sequence::make
+    const std::string& genome() const;
 
-    std::string chromosome() const;
+    const std::string& chromosome() const;
 
     bool circular() const;
 
+    // dense number of genome, same for all sequences of a
+    // genome in the process, -1 if genome is unknown.
+    // Reused like id()
+    int genomeId() const;
+
     int length() const;
 
-    const std::string& text() const;
+    std::string text() const;
 
     std::string sub(int min, int max) const;
 
+    // writes sub(min, max) (ori = 1) or its complement
+    // (ori = -1) to dst
+    void sub(char* dst, int min, int max, int ori) const;
+
     std::string tostring() const;
 
+    // compares ids
     bool operator==(const Sequence& other) const;
 
+    // by name, fast for equal names
+    bool operator<(const Sequence& other) const;
+
 private:
-    std::string name_, description_, text_;
+    std::string name_, description_;
+    int id_;
+    std::string genome_, chromosome_;
+    bool circular_;
+    int genome_id_;
+    PackedText text_;
 
     Sequence();
 };
 
 class Fragment :
-    public boost::intrusive_ref_counter<Fragment> {
+    public boost::intrusive_ref_counter<Fragment,
+            RefCounterPolicy> {
 public:
     static FragmentPtr make(SequencePtr sequence,
                             int start, int stop, int ori);
@@ -168,7 +332,8 @@ public:
 
     std::string tostring() const;
 
-    TwoFragments parts() const;
+    // made once in Fragment::make
+    const TwoFragments& parts() const;
 
     std::string text() const;
 
@@ -178,20 +343,65 @@ public:
 
     bool operator<(const Fragment& other) const;
 
+    // memory pool
+    static void* operator new(std::size_t size);
+    static void operator delete(void* p, std::size_t size);
+
+    ~Fragment();
+
 private:
     SequencePtr sequence_;
     int start_;
     int stop_; // (stop + 1) * ori
+    TwoFragments* parts_; // if parted, from memory pool
 
     Fragment();
+    Fragment(const Fragment&);
+    Fragment& operator=(const Fragment&);
 };
 
 int fragmentMin(const Fragment& fragment);
 
 int fragmentMax(const Fragment& fragment);
 
+// run of gaps in alignment row
+struct GapRun {
+    int start_; // block position of the first gap
+    int length_;
+    int gaps_before_; // gaps in the row before start_
+
+    bool operator==(const GapRun& other) const;
+};
+
+// sorted by start_, not adjacent
+typedef std::vector<GapRun> GapRuns;
+
+void findGapRuns(GapRuns& runs, const char* row, int length);
+
+// writes row of length to dst, text is fragment text
+void applyGapRuns(char* dst, const GapRuns& runs,
+                  const char* text, int length);
+
+// see Block::fragment2block etc, O(log runs)
+int gapRunsFragment2block(const GapRuns& runs,
+                          int fragmentpos);
+
+int gapRunsBlock2fragment(const GapRuns& runs, int blockpos);
+
+int gapRunsBlock2left(const GapRuns& runs, int blockpos);
+
+int gapRunsBlock2right(const GapRuns& runs, int blockpos,
+                       int fragment_length);
+
+// If compact rows are enabled, new blocks keep gap runs only
+// and build rows on demand. Disabled by default.
+bool compactRows();
+
+void setCompactRows(bool compact);
+
 class Block :
-    public boost::intrusive_ref_counter<Block> {
+    public boost::intrusive_ref_counter<Block,
+            RefCounterPolicy> {
 public:
     static BlockPtr make(const Fragments& fragments);
 
@@ -208,10 +418,24 @@ public:
 
     const Fragments& fragments() const;
 
-    const std::string& text(const FragmentPtr& fragment) const;
+    // rows in order of fragments(),
+    // returns stored rows or builds them in buffer
+    const Strings& rows(Strings& buffer) const;
+
+    // returns stored row or builds it in buffer
+    const std::string& row(int index,
+                           std::string& buffer) const;
+
+    // returns stored row or builds it in buffer
+    const std::string& text(const FragmentPtr& fragment,
+                            std::string& buffer) const;
 
     std::string tostring() const;
 
+    // hash of fragments and alignment
+    // equal blocks have equal hashes
+    Hash hash() const;
+
     int fragment2block(const FragmentPtr& fragment,
                        int fragmentpos) const;
 
@@ -224,12 +448,112 @@ public:
     int block2right(const FragmentPtr& fragment,
                     int blockpos) const;
 
+    // batch versions of the methods above,
+    // result[i] corresponds to positions[i]
+    Ints fragment2block(const FragmentPtr& fragment,
+                        const Ints& positions) const;
+
+    Ints block2fragment(const FragmentPtr& fragment,
+                        const Ints& positions) const;
+
+    Ints block2left(const FragmentPtr& fragment,
+                    const Ints& positions) const;
+
+    Ints block2right(const FragmentPtr& fragment,
+                     const Ints& positions) const;
+
+    // number of good columns, see identity
+    double identity() const;
+
+    std::string consensus() const;
+
+    // see goodColumns
+    Scores goodColumns(int min_identity, int min_length) const;
+
+    // returns block with refined alignment
+    BlockPtr refine() const;
+
+    // memory pool
+    static void* operator new(std::size_t size);
+    static void operator delete(void* p, std::size_t size);
+
 private:
     Fragments fragments_;
-    Strings rows_;
+    Strings rows_; // empty if rows are compact
+    std::vector<GapRuns> gaps_;
     int length_;
+    Hash hash_;
 
     Block();
+
+    // rows must be valid rows of fragments
+    static BlockPtr fromRows(const Fragments& fragments,
+                             Strings& rows);
+
+    // fills gaps_ and hash_ from rows_,
+    // drops rows_ if compact
+    void setGaps();
+
+    int fragmentIndex(const FragmentPtr& fragment) const;
+
+    void rowsPointers(std::vector<const char*>& rows,
+                      Strings& buffers) const;
+};
+
+// see npge.block.better
+bool blockBetter(const Block& a, const Block& b);
+
+// see npge.block.hasSelfOverlap
+bool hasSelfOverlap(const Block& block);
+
+// Index of fragments of one sequence sorted by min.
+// Stores plain coordinates in flat arrays.
+class IntervalIndex {
+public:
+    // fragments must be sorted by min and not parted
+    void assign(const Fragments& fragments);
+
+    int size() const;
+
+    int min(int index) const;
+
+    int max(int index) const;
+
+    // appends sorted indexes of fragments overlapping
+    // with [min, max]
+    void find(Ints& result, int min, int max) const;
+
+private:
+    Ints mins_;
+    Ints maxs_;
+    Ints subtree_max_;
+
+    int build(int lo, int hi);
+
+    void find(Ints& result, int min, int max,
+              int lo, int hi) const;
+};
+
+// Open addressing hash table of indexes of elements.
+// Keys are compared by caller, the table stores hashes.
+class HashIndex {
+public:
+    // hashes[i] is hash of element i
+    void assign(const Hashes& hashes);
+
+    // Returns index of first element with this hash or -1.
+    // Sets slot to pass it to next().
+    int first(Hash hash, int& slot) const;
+
+    // Returns index of next element with this hash or -1.
+    int next(Hash hash, int& slot) const;
+
+private:
+    Ints indexes_; // -1 for empty slot
+    Hashes hashes_;
+    int mask_;
+
+    int find(Hash hash, int slot) const;
 };
 
 struct SeqRecord {
@@ -237,12 +561,11 @@ struct SeqRecord {
     Fragments fragments_; // original fragments or parts
     Blocks blocks_;
 
-    Coordinates segment_tree_; // only if internal_overlaps_
+    IntervalIndex index_; // of fragments_
 
     Fragments orig_fragments_; // only if same_parts_
     Blocks orig_blocks_; // only if same_parts_
 
-    bool internal_overlaps_; // order by start != order by stop
     bool same_parts_; // equal elements in fragments_
 };
 
@@ -255,28 +578,35 @@ struct BlockRecord {
 
 typedef std::vector<BlockRecord> BlockRecords;
 
-void makeSegmentTree(Coordinates& tree,
-                     const Fragments& fragments);
-
-void findOverlapping(Fragments& result,
-                     const Coordinates& tree,
-                     const Fragments& fragments,
-                     const FragmentPtr& fragment);
-
 class BlockSet :
-    public boost::intrusive_ref_counter<BlockSet> {
+    public boost::intrusive_ref_counter<BlockSet,
+            RefCounterPolicy> {
 public:
+    // sequences are processed in parallel
+    // if workers > 1 and there are many fragments
     static BlockSetPtr make(const Sequences& sequences,
                             const Blocks& blocks,
-                            const Strings& names);
+                            const Strings& names,
+                            int workers = 1);
+
+    // blockset of blocks with these names, names are kept.
+    // Fragments are taken from sorted records of this
+    // blockset, so nothing is sorted again, unless a block
+    // with many names is selected under some of them
+    BlockSetPtr subset(const Strings& names) const;
 
     bool sameSequences(const BlockSet& other) const;
 
     // 0 on success
     const char* cmp(const BlockSet& other) const;
 
+    // compares hashes first
     bool operator==(const BlockSet& other) const;
 
+    // hash of blocks, does not depend on their order
+    // equal blocksets have equal hashes
+    Hash hash() const;
+
     int size() const;
 
     bool isPartition() const;
@@ -310,6 +640,17 @@ public:
 
     Fragments overlapping(const FragmentPtr& fragment) const;
 
+    // result[i] is overlapping(fragments[i])
+    std::vector<Fragments> overlapping(
+            const Fragments& fragments) const;
+
+    // blocks having fragments overlapping with block
+    Blocks overlappingBlocks(const BlockPtr& block) const;
+
+    // result[i] is overlappingBlocks(other.blockAt(i))
+    std::vector<Blocks> overlappingBlocks(
+            const BlockSet& other) const;
+
     FragmentPtr next(const FragmentPtr& fragment) const;
 
     FragmentPtr prev(const FragmentPtr& fragment) const;
@@ -321,14 +662,233 @@ private:
     SeqRecords seq_records_;
 
     BlockRecords block2name_;
-    BlockRecords name2block_;
+    HashIndex name_index_; // indexes of block2name_
+    HashIndex block_index_; // indexes of block2name_
 
     Fragments parts_;
     Fragments parent_of_parts_;
 
     bool isPartition_;
+    Hash hash_;
 
     BlockSet();
+
+    int blockIndex(const BlockPtr& block) const;
+
+    int nameIndex(const std::string& name) const;
+
+    // appends parts overlapping with fragment
+    void overlappingParts(Fragments& result, Ints& indexes,
+                          const FragmentPtr& fragment) const;
+
+    void overlappingBlocks(std::vector<Blocks>& result,
+                           const Blocks& queries) const;
+};
+
+// BlockSets are passed between Lua states by handles.
+// A shared blockset is kept until it is unshared.
+int shareBlockSet(const BlockSetPtr& bs);
+
+// throws if the handle is unknown
+BlockSetPtr sharedBlockSet(int handle);
+
+// returns the blockset and forgets the handle
+BlockSetPtr unshareBlockSet(int handle);
+
+// part of a fragment added to BlockSetBuilder
+struct BuilderPart {
+    int min_;
+    int max_;
+    FragmentPtr fragment_; // original fragment, may be parted
+    const Block* block_;
+
+    // by min_, max_, then by pointers
+    bool operator<(const BuilderPart& other) const;
+};
+
+typedef std::set<BuilderPart> BuilderParts;
+
+struct BuilderSeqRecord {
+    SequencePtr sequence_;
+    BuilderParts parts_; // sorted by min
+    // upper bound of length of parts, not decreased
+    // when parts are removed
+    int max_length_;
+};
+
+typedef std::map<std::string, BuilderSeqRecord>
+    BuilderSeqRecords;
+
+// Mutable set of blocks. Blocks are added and removed in
+// O(log n) per fragment. Can be frozen into a BlockSet.
+class BlockSetBuilder :
+    public boost::intrusive_ref_counter<BlockSetBuilder,
+            RefCounterPolicy> {
+public:
+    static BlockSetBuilderPtr make(const Sequences& sequences);
+
+    // returns false if the block was already added
+    bool addBlock(const BlockPtr& block,
+                  const std::string& name);
+
+    // name of the block is generated from a counter
+    bool addBlock(const BlockPtr& block);
+
+    // returns false if the block was not added
+    bool removeBlock(const BlockPtr& block);
+
+    // searches by pointer
+    bool hasBlock(const BlockPtr& block) const;
+
+    int size() const;
+
+    Blocks blocks() const;
+
+    // fragments of added blocks, overlapping with fragment
+    Fragments overlapping(const FragmentPtr& fragment) const;
+
+    // returns if any of fragments of added blocks overlaps
+    // with fragment
+    bool hasOverlapping(const FragmentPtr& fragment) const;
+
+    BlockSetPtr freeze(int workers = 1) const;
+
+private:
+    Sequences sequences_;
+    BuilderSeqRecords seq_records_;
+    std::map<BlockPtr, std::string> block2name_;
+    int next_name_;
+
+    BlockSetBuilder();
+
+    void addParts(const BlockPtr& block);
+    void removeParts(const BlockPtr& block);
+    void overlappingParts(Fragments& result,
+                          const FragmentPtr& fragment) const;
+};
+
+// Selects blocks from orig and added (if not NULL) greedily:
+// better blocks first (see blockBetter), blocks from orig
+// first among equal blocks. Skips blocks overlapping with
+// selected blocks or with themselves.
+BlockSetPtr blocksWithoutOverlaps(const BlockSet& orig,
+                                  const BlockSet* added);
+
+// see npge.algo.Multiply
+// Rows of new blocks are sliced from rows of blocks of bs1.
+BlockSetPtr multiply(const BlockSet& bs1, const BlockSet& bs2,
+                     int workers = 1);
+
+struct GoodSubblocksParams {
+    int min_length_;
+    int min_identity_; // see npge.alignment.minIdentical
+    int frame_length_;
+    int min_end_;
+};
+
+// see npge.block.goodSubblocks, appends subblocks to result
+void goodSubblocks(Blocks& result, const BlockPtr& block,
+                   const GoodSubblocksParams& params);
+
+// Function applied to each block by mapBlocks.
+// Must be safe to call from several threads at once.
+class BlockKernel {
+public:
+    virtual ~BlockKernel();
+
+    // appends new blocks to result
+    virtual void apply(Blocks& result,
+                       const BlockPtr& block) const = 0;
+};
+
+class GoodSubblocksKernel : public BlockKernel {
+public:
+    GoodSubblocksKernel(const GoodSubblocksParams& params);
+
+    void apply(Blocks& result, const BlockPtr& block) const;
+
+private:
+    GoodSubblocksParams params_;
+};
+
+class RefineKernel : public BlockKernel {
+public:
+    void apply(Blocks& result, const BlockPtr& block) const;
+};
+
+// Applies kernel to blocks of bs in parallel, see parallelFor.
+// Results follow the order of blocks in bs.
+BlockSetPtr mapBlocks(const BlockSet& bs,
+                      const BlockKernel& kernel, int workers);
+
+// Parameters of nativeHits, see npge.algo.NativeHits
+struct NativeHitsParams {
+    int word_length_; // odd, k-mers used as seeds
+    int window_; // minimizer of each window of k-mers
+    int max_occurrences_; // more frequent k-mers are skipped
+    int band_; // max offset from diagonal in extension
+    int x_drop_; // extension stops when score drops by it
+    int chunk_; // rows of extension matrix kept at once
+    int match_, mismatch_, gap_; // scores
+    int min_length_; // min length of alignment
+    bool same_; // query and bank are searched once per pair
+
+    NativeHitsParams();
+};
+
+// Finds hits of sequences of query in sequences of bank.
+// Seeds are shared minimizers, extended by banded
+// X-drop alignment. Blocks have 2 fragments: query and bank.
+BlockSetPtr nativeHits(const BlockSet& query,
+                       const BlockSet& bank,
+                       const NativeHitsParams& params,
+                       int workers);
+
+// Reader of output of blastn, see npge.algo.BlastHits.
+// Reads default (pairwise) format and tabular format
+// (-outfmt 6 or 7) with fields
+// qseqid stitle qstart qend sstart send btop.
+// Rows of tabular hits are restored from BTOP.
+// In mode same, hits where query > bank are skipped.
+class BlastReader {
+public:
+    BlastReader(const BlockSet& query, const BlockSet& bank,
+                bool same);
+
+    void readLine(const char* line, int size);
+
+    // returns hits, throws if no lines were read
+    BlockSetPtr blockSet(int workers);
+
+private:
+    const BlockSet& query_;
+    const BlockSet& bank_;
+    bool same_;
+    bool empty_;
+    Blocks blocks_;
+    // current hit of pairwise format
+    bool in_hit_;
+    std::string query_name_, bank_name_;
+    std::string query_row_, bank_row_;
+    int query_start_, query_stop_; // 1-based, 0 if unknown
+    int bank_start_, bank_stop_;
+
+    bool goodHit() const;
+    void resetHit();
+    void readRow(std::string& row, int& start, int& stop,
+                 const char* begin, const char* end);
+    void tryAdd();
+    void readTabular(const char* begin, const char* end);
+    void makeFragments(FragmentPtr& query_f,
+                       FragmentPtr& bank_f,
+                       const std::string& query_name,
+                       const std::string& bank_name,
+                       int query_start, int query_stop,
+                       int bank_start, int bank_stop) const;
+    void addHit(const FragmentPtr& query_f,
+                const FragmentPtr& bank_f,
+                const std::string& query_row,
+                const std::string& bank_row);
 };
 
 }
@@ -0,0 +1,199 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+#include "npge.hpp"
+
+namespace lnpge {
+
+// part of a fragment of a query block
+struct QueryPart {
+    const Sequence* sequence_;
+    int min_;
+    int max_;
+    int query_; // index of query block
+};
+
+typedef std::vector<QueryPart> QueryParts;
+typedef QueryParts::const_iterator QueryIt;
+
+// by sequence name, then by min
+struct QueryPartLess {
+    bool operator()(const QueryPart& a,
+                    const QueryPart& b) const {
+        if (!(*a.sequence_ == *b.sequence_)) {
+            return *a.sequence_ < *b.sequence_;
+        }
+        return a.min_ < b.min_;
+    }
+};
+
+static void addParts(QueryParts& parts,
+                     const FragmentPtr& fragment,
+                     int query) {
+    if (fragment->parted()) {
+        const TwoFragments& two = fragment->parts();
+        addParts(parts, two.first, query);
+        addParts(parts, two.second, query);
+        return;
+    }
+    QueryPart part;
+    part.sequence_ = fragment->sequence().get();
+    part.min_ = fragmentMin(*fragment);
+    part.max_ = fragmentMax(*fragment);
+    part.query_ = query;
+    parts.push_back(part);
+}
+
+// index of first fragment with min >= value
+static int lowerBound(const IntervalIndex& index, int value) {
+    int lo = 0, hi = index.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index.min(mid) < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// few queries are looked up in the interval index,
+// sweep is used if queries are comparable with fragments
+const int LOOKUP_FACTOR = 8;
+
+static void lookup(std::vector<Blocks>& result,
+                   QueryIt begin, QueryIt end,
+                   const SeqRecord& record) {
+    Ints indexes;
+    for (QueryIt q = begin; q != end; ++q) {
+        indexes.clear();
+        record.index_.find(indexes, q->min_, q->max_);
+        BOOST_FOREACH (int i, indexes) {
+            result[q->query_].push_back(record.blocks_[i]);
+        }
+    }
+}
+
+// Sweep over query parts and fragments of the record.
+// Both are sorted by min. An item is active until the sweep
+// passes its max. Each newcomer overlaps with all active
+// items of the other side. The sweep starts from fragments
+// reaching the first query and stops after the last query.
+static void sweep(std::vector<Blocks>& result,
+                  QueryIt begin, QueryIt end,
+                  const SeqRecord& record) {
+    const IntervalIndex& index = record.index_;
+    int nf = index.size();
+    if ((end - begin) * LOOKUP_FACTOR < nf) {
+        lookup(result, begin, end, record);
+        return;
+    }
+    int first_min = begin->min_;
+    Ints active_f;
+    index.find(active_f, first_min, first_min);
+    int f = lowerBound(index, first_min);
+    // fragments starting at first_min are newcomers
+    active_f.resize(std::lower_bound(active_f.begin(),
+                    active_f.end(), f) - active_f.begin());
+    std::vector<QueryIt> active_q;
+    QueryIt q = begin;
+    while (q != end || (f < nf && !active_q.empty())) {
+        if (f == nf || (q != end && q->min_ <= index.min(f))) {
+            int n = 0;
+            for (int i = 0; i < active_f.size(); i++) {
+                int j = active_f[i];
+                if (index.max(j) >= q->min_) {
+                    active_f[n] = j;
+                    n += 1;
+                    const BlockPtr& block = record.blocks_[j];
+                    result[q->query_].push_back(block);
+                }
+            }
+            active_f.resize(n);
+            active_q.push_back(q);
+            ++q;
+        } else {
+            int min = index.min(f);
+            const BlockPtr& block = record.blocks_[f];
+            int n = 0;
+            for (int i = 0; i < active_q.size(); i++) {
+                QueryIt j = active_q[i];
+                if (j->max_ >= min) {
+                    active_q[n] = j;
+                    n += 1;
+                    result[j->query_].push_back(block);
+                }
+            }
+            active_q.resize(n);
+            active_f.push_back(f);
+            f += 1;
+        }
+    }
+}
+
+void BlockSet::overlappingBlocks(std::vector<Blocks>& result,
+                                 const Blocks& queries) const {
+    int n = queries.size();
+    result.clear();
+    result.resize(n);
+    QueryParts parts;
+    for (int i = 0; i < n; i++) {
+        BOOST_FOREACH (const FragmentPtr& f,
+                       queries[i]->fragments()) {
+            addParts(parts, f, i);
+        }
+    }
+    std::sort(parts.begin(), parts.end(), QueryPartLess());
+    // merge with seq_records_ sorted by sequence name
+    SeqRecords::const_iterator record = seq_records_.begin();
+    QueryIt begin = parts.begin();
+    while (begin != parts.end()) {
+        const Sequence& sequence = *begin->sequence_;
+        QueryIt end = begin;
+        while (end != parts.end() &&
+                *end->sequence_ == sequence) {
+            ++end;
+        }
+        while (record != seq_records_.end() &&
+                *record->sequence_ < sequence) {
+            ++record;
+        }
+        if (record != seq_records_.end() &&
+                *record->sequence_ == sequence) {
+            sweep(result, begin, end, *record);
+        }
+        begin = end;
+    }
+    BOOST_FOREACH (Blocks& blocks, result) {
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()),
+                     blocks.end());
+    }
+}
+
+Blocks BlockSet::overlappingBlocks(
+        const BlockPtr& block) const {
+    std::vector<Blocks> result;
+    overlappingBlocks(result, Blocks(1, block));
+    return result[0];
+}
+
+std::vector<Blocks> BlockSet::overlappingBlocks(
+        const BlockSet& other) const {
+    int n = other.size();
+    Blocks queries(n);
+    for (int i = 0; i < n; i++) {
+        queries[i] = other.blockAt(i);
+    }
+    std::vector<Blocks> result;
+    overlappingBlocks(result, queries);
+    return result;
+}
+
+}
@@ -0,0 +1,169 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "npge.hpp"
+#include "throw_assert.hpp"
+
+namespace lnpge {
+
+// Each byte holds 4 bases, base i is at bits 2 * (i % 4).
+// Codes: A => 0, C => 1, G => 2, T => 3.
+// Complement of code c is 3 - c.
+// N is stored as A in bases_ and listed in n_runs_.
+
+const int BASES_IN_BYTE = 4;
+
+static const char LETTERS[] = "ACGT";
+static const char COMPLEMENT_LETTERS[] = "TGCA";
+
+static int toCode(char c) {
+    switch (c) {
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+// letters of all 4 bases of a byte
+struct DecodeTable {
+    char direct[256][BASES_IN_BYTE];
+    // reversed complement of the byte
+    char complement[256][BASES_IN_BYTE];
+
+    DecodeTable() {
+        for (int byte = 0; byte < 256; byte++) {
+            for (int i = 0; i < BASES_IN_BYTE; i++) {
+                int code = (byte >> (2 * i)) & 3;
+                direct[byte][i] = LETTERS[code];
+                int i1 = BASES_IN_BYTE - i - 1;
+                complement[byte][i1] = COMPLEMENT_LETTERS[code];
+            }
+        }
+    }
+};
+
+static const DecodeTable DECODE_TABLE;
+
+struct RunStopLess {
+    bool operator()(const StartStop& run, int pos) const {
+        return run.second < pos;
+    }
+};
+
+PackedText::PackedText():
+    length_(0) {
+}
+
+void PackedText::assign(const char* text, int length) {
+    ASSERT_LTE(0, length);
+    length_ = length;
+    int nbytes = (length + BASES_IN_BYTE - 1) / BASES_IN_BYTE;
+    std::vector<unsigned char> bases(nbytes, 0);
+    Coordinates n_runs;
+    for (int i = 0; i < length; i++) {
+        char c = text[i];
+        if (c == 'N') {
+            if (!n_runs.empty() &&
+                    n_runs.back().second == i - 1) {
+                n_runs.back().second = i;
+            } else {
+                n_runs.push_back(StartStop(i, i));
+            }
+        }
+        int shift = 2 * (i % BASES_IN_BYTE);
+        bases[i / BASES_IN_BYTE] |= (toCode(c) << shift);
+    }
+    bases_.swap(bases);
+    // copy to release extra capacity
+    Coordinates(n_runs.begin(), n_runs.end()).swap(n_runs_);
+}
+
+int PackedText::length() const {
+    return length_;
+}
+
+int PackedText::code(int pos) const {
+    unsigned char byte = bases_[pos / BASES_IN_BYTE];
+    return (byte >> (2 * (pos % BASES_IN_BYTE))) & 3;
+}
+
+void PackedText::unpack(char* dst, int start,
+                        int length) const {
+    ASSERT_LTE(0, start);
+    ASSERT_LTE(0, length);
+    ASSERT_LTE(start + length, length_);
+    int stop = start + length;
+    int pos = start;
+    // head: up to byte boundary
+    while (pos < stop && pos % BASES_IN_BYTE != 0) {
+        dst[pos - start] = LETTERS[code(pos)];
+        pos += 1;
+    }
+    // whole bytes
+    while (pos + BASES_IN_BYTE <= stop) {
+        unsigned char byte = bases_[pos / BASES_IN_BYTE];
+        memcpy(dst + pos - start, DECODE_TABLE.direct[byte],
+               BASES_IN_BYTE);
+        pos += BASES_IN_BYTE;
+    }
+    // tail
+    while (pos < stop) {
+        dst[pos - start] = LETTERS[code(pos)];
+        pos += 1;
+    }
+    // N runs
+    Coordinates::const_iterator it = std::lower_bound(
+            n_runs_.begin(), n_runs_.end(), start,
+            RunStopLess());
+    for (; it != n_runs_.end() && it->first < stop; ++it) {
+        int min = std::max(it->first, start);
+        int max = std::min(it->second, stop - 1);
+        memset(dst + min - start, 'N', max - min + 1);
+    }
+}
+
+void PackedText::unpackComplement(char* dst, int start,
+                                  int length) const {
+    ASSERT_LTE(0, start);
+    ASSERT_LTE(0, length);
+    ASSERT_LTE(start + length, length_);
+    int stop = start + length;
+    // letter at pos goes to dst[last - pos]
+    int last = stop - 1;
+    int pos = start;
+    while (pos < stop && pos % BASES_IN_BYTE != 0) {
+        dst[last - pos] = COMPLEMENT_LETTERS[code(pos)];
+        pos += 1;
+    }
+    while (pos + BASES_IN_BYTE <= stop) {
+        unsigned char byte = bases_[pos / BASES_IN_BYTE];
+        int dst_pos = last - (pos + BASES_IN_BYTE - 1);
+        memcpy(dst + dst_pos, DECODE_TABLE.complement[byte],
+               BASES_IN_BYTE);
+        pos += BASES_IN_BYTE;
+    }
+    while (pos < stop) {
+        dst[last - pos] = COMPLEMENT_LETTERS[code(pos)];
+        pos += 1;
+    }
+    Coordinates::const_iterator it = std::lower_bound(
+            n_runs_.begin(), n_runs_.end(), start,
+            RunStopLess());
+    for (; it != n_runs_.end() && it->first < stop; ++it) {
+        int min = std::max(it->first, start);
+        int max = std::min(it->second, stop - 1);
+        memset(dst + last - max, 'N', max - min + 1);
+    }
+}
+
+}
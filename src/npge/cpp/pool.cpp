@@ -0,0 +1,110 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <new>
+
+#include "pool.hpp"
+
+namespace lnpge {
+
+const std::size_t SLAB_SIZE = 64 * 1024;
+
+// chunks are aligned as results of operator new
+const std::size_t CHUNK_ALIGN = 16;
+
+// number of chunks moved between PoolCache and Pool
+const int BATCH_SIZE = 64;
+
+struct FreeChunk {
+    FreeChunk* next_;
+};
+
+static std::size_t chunkSize(std::size_t size) {
+    if (size < sizeof(FreeChunk)) {
+        size = sizeof(FreeChunk);
+    }
+    return (size + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+}
+
+// called under the lock
+static void addSlab(Pool& pool, std::size_t size) {
+    std::size_t chunk_size = chunkSize(size);
+    std::size_t nchunks = SLAB_SIZE / chunk_size;
+    if (nchunks == 0) {
+        nchunks = 1;
+    }
+    char* slab = static_cast<char*>(
+            ::operator new(nchunks * chunk_size));
+    for (std::size_t i = 0; i < nchunks; i++) {
+        FreeChunk* chunk = reinterpret_cast<FreeChunk*>(
+                slab + i * chunk_size);
+        chunk->next_ = static_cast<FreeChunk*>(pool.free_);
+        pool.free_ = chunk;
+    }
+}
+
+// moves up to n chunks from list src to list dst
+static int moveChunks(void*& dst, void*& src, int n) {
+    int moved = 0;
+    while (moved < n && src) {
+        FreeChunk* chunk = static_cast<FreeChunk*>(src);
+        src = chunk->next_;
+        chunk->next_ = static_cast<FreeChunk*>(dst);
+        dst = chunk;
+        moved += 1;
+    }
+    return moved;
+}
+
+static void refill(Pool& pool, PoolCache& cache,
+                   std::size_t size) {
+    SpinLockGuard lock(pool.lock_);
+    if (!pool.free_) {
+        addSlab(pool, size);
+    }
+    cache.size_ += moveChunks(cache.free_, pool.free_,
+                              BATCH_SIZE);
+}
+
+static void flush(Pool& pool, PoolCache& cache) {
+    SpinLockGuard lock(pool.lock_);
+    cache.size_ -= moveChunks(pool.free_, cache.free_,
+                              BATCH_SIZE);
+}
+
+void* poolAllocate(Pool& pool, PoolCache& cache,
+                   std::size_t size) {
+#ifndef NPGE_NO_POOL
+    if (!cache.free_) {
+        refill(pool, cache, size);
+    }
+    FreeChunk* chunk = static_cast<FreeChunk*>(cache.free_);
+    cache.free_ = chunk->next_;
+    cache.size_ -= 1;
+    return chunk;
+#else
+    return ::operator new(size);
+#endif
+}
+
+void poolDeallocate(Pool& pool, PoolCache& cache,
+                    void* chunk) {
+    if (!chunk) {
+        return;
+    }
+#ifndef NPGE_NO_POOL
+    FreeChunk* free_chunk = static_cast<FreeChunk*>(chunk);
+    free_chunk->next_ = static_cast<FreeChunk*>(cache.free_);
+    cache.free_ = free_chunk;
+    cache.size_ += 1;
+    if (cache.size_ > 2 * BATCH_SIZE) {
+        flush(pool, cache);
+    }
+#else
+    ::operator delete(chunk);
+#endif
+}
+
+}
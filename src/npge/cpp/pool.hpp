@@ -0,0 +1,46 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#ifndef NPGE_POOL_HPP_
+#define NPGE_POOL_HPP_
+
+#include <cstddef>
+
+#include "sync.hpp"
+
+namespace lnpge {
+
+// Free list of memory chunks of one size.
+// Chunks are cut from slabs, which are never returned to
+// the system. Safe to use from multiple threads.
+// Define NPGE_NO_POOL to use global operator new instead.
+struct Pool {
+    void* free_;
+    SpinLock lock_;
+};
+
+#define NPGE_POOL_INIT {0, NPGE_SPIN_LOCK_INIT}
+
+// Free list of a thread, declare it NPGE_THREAD_LOCAL.
+// Chunks are moved between the cache and the Pool in
+// batches, so the lock of the Pool is rarely taken.
+// Chunks cached by a thread are lost when it exits,
+// a cache keeps at most 2 batches.
+struct PoolCache {
+    void* free_;
+    int size_;
+};
+
+#define NPGE_POOL_CACHE_INIT {0, 0}
+
+void* poolAllocate(Pool& pool, PoolCache& cache,
+                   std::size_t size);
+
+void poolDeallocate(Pool& pool, PoolCache& cache,
+                    void* chunk);
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <map>
+#include <stdexcept>
+
+#include "npge.hpp"
+#include "sync.hpp"
+
+namespace lnpge {
+
+typedef std::map<int, BlockSetPtr> HandleToBlockSet;
+
+static HandleToBlockSet shared_blocksets_;
+static int last_handle_ = 0;
+static SpinLock shared_lock_ = NPGE_SPIN_LOCK_INIT;
+
+int shareBlockSet(const BlockSetPtr& bs) {
+    SpinLockGuard lock(shared_lock_);
+    last_handle_ += 1;
+    shared_blocksets_[last_handle_] = bs;
+    return last_handle_;
+}
+
+BlockSetPtr sharedBlockSet(int handle) {
+    SpinLockGuard lock(shared_lock_);
+    HandleToBlockSet::const_iterator it =
+        shared_blocksets_.find(handle);
+    if (it == shared_blocksets_.end()) {
+        throw std::logic_error("Unknown handle of BlockSet");
+    }
+    return it->second;
+}
+
+BlockSetPtr unshareBlockSet(int handle) {
+    BlockSetPtr bs;
+    {
+        SpinLockGuard lock(shared_lock_);
+        HandleToBlockSet::iterator it =
+            shared_blocksets_.find(handle);
+        if (it == shared_blocksets_.end()) {
+            throw std::logic_error(
+                "Unknown handle of BlockSet");
+        }
+        bs.swap(it->second);
+        shared_blocksets_.erase(it);
+    }
+    // caller releases the blockset outside of the lock
+    return bs;
+}
+
+}
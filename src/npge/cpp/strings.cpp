@@ -4,6 +4,7 @@
  */
 
 #include <cstring>
+#include <algorithm>
 #include <boost/algorithm/string/join.hpp>
 
 #include "npge.hpp"
@@ -89,7 +90,7 @@ static const unsigned char ATGCN_GAP_MAP[] = {
 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
 
-int complement(char* dst, const char* src, int length) {
+int complementScalar(char* dst, const char* src, int length) {
     for (int i = 0; i < length; i++) {
         int i1 = length - i - 1;
         unsigned char c = src[i];
@@ -98,7 +99,7 @@ int complement(char* dst, const char* src, int length) {
     return length;
 }
 
-int toAtgcn(char* dst, const char* src, int length) {
+int toAtgcnScalar(char* dst, const char* src, int length) {
     int dst_i = 0;
     for (int src_i = 0; src_i < length; src_i++) {
         unsigned char c = src[src_i];
@@ -111,7 +112,8 @@ int toAtgcn(char* dst, const char* src, int length) {
     return dst_i;
 }
 
-int toAtgcnAndGap(char* dst, const char* src, int length) {
+int toAtgcnAndGapScalar(char* dst, const char* src,
+                        int length) {
     int dst_i = 0;
     for (int src_i = 0; src_i < length; src_i++) {
         unsigned char c = src[src_i];
@@ -182,21 +184,16 @@ bool isColumnIdentGap(const char** rows, int nrows, int i) {
 double identity(const char** rows, int nrows,
                 int start, int stop) {
     double ident = 0;
-    for (int i = start; i <= stop; i++) {
-        if (isColumnGood(rows, nrows, i)) {
-            ident += 1;
-        }
+    for (int i = start; i <= stop; i += COLUMNS_IN_MASK) {
+        int length = std::min(COLUMNS_IN_MASK, stop - i + 1);
+        ColumnMasks masks = classifyColumns(rows, nrows,
+                                            i, length);
+        ident += countBits(masks.good);
     }
     return ident;
 }
 
-char consensusAtPos(const char** rows, int nrows, int i) {
-    int count[TOINT_MAX + 1] = {0, 0, 0, 0, 0, 0};
-    for (int irow = 0; irow < nrows; irow++) {
-        char letter = rows[irow][i];
-        int index = TOINT_MAP[letter];
-        count[index] += 1;
-    }
+static char consensusLetter(const int* count) {
     const int A = TOINT_MAP['A'];
     const int N = TOINT_MAX;
     int max_index = N; // N is the default
@@ -210,6 +207,16 @@ char consensusAtPos(const char** rows, int nrows, int i) {
     return FROMINT_MAP[max_index];
 }
 
+char consensusAtPos(const char** rows, int nrows, int i) {
+    int count[TOINT_MAX + 1] = {0, 0, 0, 0, 0, 0};
+    for (int irow = 0; irow < nrows; irow++) {
+        char letter = rows[irow][i];
+        int index = TOINT_MAP[letter];
+        count[index] += 1;
+    }
+    return consensusLetter(count);
+}
+
 // size of dst is length. 0 byte is not required
 void consensus(char* dst, const char** rows,
                int nrows, int length) {
@@ -218,6 +225,53 @@ void consensus(char* dst, const char** rows,
     }
 }
 
+void columnsStats(ColumnsStats& stats,
+                  const char** rows, int nrows, int length,
+                  int min_identity, int min_length) {
+    stats.ident = 0;
+    stats.consensus.resize(length);
+    stats.rows_ident.assign(nrows, 0);
+    int nmasks = (length + COLUMNS_IN_MASK - 1) /
+        COLUMNS_IN_MASK;
+    ColumnMasksVector masks(nmasks);
+    int count[COLUMNS_IN_MASK][TOINT_MAX + 1];
+    char cons[COLUMNS_IN_MASK];
+    // columns are processed by groups of COLUMNS_IN_MASK,
+    // so a group of each row stays in cache
+    for (int k = 0; k < nmasks; k++) {
+        int start = k * COLUMNS_IN_MASK;
+        int block_length = std::min(COLUMNS_IN_MASK,
+                                    length - start);
+        masks[k] = classifyColumns(rows, nrows,
+                                   start, block_length);
+        stats.ident += countBits(masks[k].good);
+        memset(count, 0, sizeof(count));
+        for (int irow = 0; irow < nrows; irow++) {
+            const unsigned char* row =
+                reinterpret_cast<const unsigned char*>(
+                        rows[irow] + start);
+            for (int j = 0; j < block_length; j++) {
+                count[j][TOINT_MAP[row[j]]] += 1;
+            }
+        }
+        for (int j = 0; j < block_length; j++) {
+            cons[j] = consensusLetter(count[j]);
+        }
+        stats.consensus.replace(start, block_length,
+                                cons, block_length);
+        for (int irow = 0; irow < nrows; irow++) {
+            const char* row = rows[irow] + start;
+            int same = 0;
+            for (int j = 0; j < block_length; j++) {
+                same += (row[j] == cons[j] && cons[j] != 'N');
+            }
+            stats.rows_ident[irow] += same;
+        }
+    }
+    stats.scores = scoreColumns(masks, length,
+                                min_identity, min_length);
+}
+
 // size of dst is at least length + 2, 0 byte is not required
 int ShortForm_diff(char* dst, const char* consensus,
                    const char* text, int length) {
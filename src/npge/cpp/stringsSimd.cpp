@@ -0,0 +1,368 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+// SIMD versions of complement, toAtgcn and toAtgcnAndGap.
+// Kernels are selected at runtime according to the CPU.
+// Define NPGE_NO_SIMD to use scalar versions only.
+
+#include <cstring>
+
+#include "npge.hpp"
+
+#ifndef NPGE_NO_SIMD
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define NPGE_X86_SIMD
+#define NPGE_TARGET(t) __attribute__((target(t)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define NPGE_X86_SIMD
+#define NPGE_TARGET(t)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+namespace lnpge {
+
+typedef int (*StringKernel)(char* dst, const char* src,
+                            int length);
+
+struct StringKernels {
+    const char* name;
+    StringKernel complement;
+    StringKernel toAtgcn;
+    StringKernel toAtgcnAndGap;
+};
+
+#ifdef NPGE_X86_SIMD
+
+// Complement: A <-> T is xor 0x15, C <-> G is xor 0x04.
+// Same for lowercase letters. Other bytes are not changed.
+// Letter x is one of a, A if (x | 0x20) == 'a'.
+//
+// toAtgcn and toAtgcnAndGap: if all bytes of a chunk are
+// ACGTN (any case) or gaps (only toAtgcnAndGap), the result
+// is the uppercased chunk. Otherwise the chunk is passed to
+// the scalar version which maps and compacts it.
+
+NPGE_TARGET("sse4.1")
+static __m128i complementChunk128(__m128i x) {
+    const __m128i reverse = _mm_setr_epi8(
+            15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0);
+    x = _mm_shuffle_epi8(x, reverse);
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i at = _mm_or_si128(
+            _mm_cmpeq_epi8(lower, _mm_set1_epi8('a')),
+            _mm_cmpeq_epi8(lower, _mm_set1_epi8('t')));
+    __m128i cg = _mm_or_si128(
+            _mm_cmpeq_epi8(lower, _mm_set1_epi8('c')),
+            _mm_cmpeq_epi8(lower, _mm_set1_epi8('g')));
+    __m128i flip = _mm_or_si128(
+            _mm_and_si128(at, _mm_set1_epi8(0x15)),
+            _mm_and_si128(cg, _mm_set1_epi8(0x04)));
+    return _mm_xor_si128(x, flip);
+}
+
+NPGE_TARGET("sse4.1")
+static int complementSse41(char* dst, const char* src,
+                           int length) {
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const char* from = src + length - i - 16;
+        __m128i x = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(from));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         complementChunk128(x));
+    }
+    complementScalar(dst + i, src, length - i);
+    return length;
+}
+
+// returns uppercased x, sets all_valid
+template<bool GAP>
+NPGE_TARGET("sse4.1")
+static __m128i atgcnChunk128(__m128i x, bool& all_valid) {
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    __m128i a = _mm_cmpeq_epi8(lower, _mm_set1_epi8('a'));
+    __m128i t = _mm_cmpeq_epi8(lower, _mm_set1_epi8('t'));
+    __m128i g = _mm_cmpeq_epi8(lower, _mm_set1_epi8('g'));
+    __m128i c = _mm_cmpeq_epi8(lower, _mm_set1_epi8('c'));
+    __m128i n = _mm_cmpeq_epi8(lower, _mm_set1_epi8('n'));
+    __m128i letters = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(a, t),
+                         _mm_or_si128(g, c)), n);
+    __m128i valid = letters;
+    if (GAP) {
+        valid = _mm_or_si128(valid,
+                _mm_cmpeq_epi8(x, _mm_set1_epi8('-')));
+    }
+    all_valid = (_mm_movemask_epi8(valid) == 0xFFFF);
+    __m128i case_bit = _mm_and_si128(letters,
+                                     _mm_set1_epi8(0x20));
+    return _mm_andnot_si128(case_bit, x);
+}
+
+template<bool GAP>
+NPGE_TARGET("sse4.1")
+static int toAtgcnSse41(char* dst, const char* src,
+                        int length) {
+    int dst_i = 0;
+    int src_i = 0;
+    for (; src_i + 16 <= length; src_i += 16) {
+        __m128i x = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(src + src_i));
+        bool all_valid;
+        __m128i y = atgcnChunk128<GAP>(x, all_valid);
+        if (all_valid) {
+            _mm_storeu_si128(
+                    reinterpret_cast<__m128i*>(dst + dst_i), y);
+            dst_i += 16;
+        } else if (GAP) {
+            dst_i += toAtgcnAndGapScalar(dst + dst_i,
+                                         src + src_i, 16);
+        } else {
+            dst_i += toAtgcnScalar(dst + dst_i,
+                                   src + src_i, 16);
+        }
+    }
+    if (GAP) {
+        dst_i += toAtgcnAndGapScalar(dst + dst_i, src + src_i,
+                                     length - src_i);
+    } else {
+        dst_i += toAtgcnScalar(dst + dst_i, src + src_i,
+                               length - src_i);
+    }
+    return dst_i;
+}
+
+NPGE_TARGET("avx2")
+static __m256i complementChunk256(__m256i x) {
+    // reverse bytes in each lane, then swap lanes
+    const __m256i reverse = _mm256_setr_epi8(
+            15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0,
+            15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0);
+    x = _mm256_shuffle_epi8(x, reverse);
+    x = _mm256_permute4x64_epi64(x, 0x4E);
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i at = _mm256_or_si256(
+            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('a')),
+            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('t')));
+    __m256i cg = _mm256_or_si256(
+            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('c')),
+            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('g')));
+    __m256i flip = _mm256_or_si256(
+            _mm256_and_si256(at, _mm256_set1_epi8(0x15)),
+            _mm256_and_si256(cg, _mm256_set1_epi8(0x04)));
+    return _mm256_xor_si256(x, flip);
+}
+
+NPGE_TARGET("avx2")
+static int complementAvx2(char* dst, const char* src,
+                          int length) {
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const char* from = src + length - i - 32;
+        __m256i x = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(from));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            complementChunk256(x));
+    }
+    complementScalar(dst + i, src, length - i);
+    return length;
+}
+
+template<bool GAP>
+NPGE_TARGET("avx2")
+static __m256i atgcnChunk256(__m256i x, bool& all_valid) {
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    __m256i a = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('a'));
+    __m256i t = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('t'));
+    __m256i g = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('g'));
+    __m256i c = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('c'));
+    __m256i n = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('n'));
+    __m256i letters = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(a, t),
+                            _mm256_or_si256(g, c)), n);
+    __m256i valid = letters;
+    if (GAP) {
+        valid = _mm256_or_si256(valid,
+                _mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')));
+    }
+    all_valid = (_mm256_movemask_epi8(valid) == -1);
+    __m256i case_bit = _mm256_and_si256(letters,
+                                        _mm256_set1_epi8(0x20));
+    return _mm256_andnot_si256(case_bit, x);
+}
+
+template<bool GAP>
+NPGE_TARGET("avx2")
+static int toAtgcnAvx2(char* dst, const char* src,
+                       int length) {
+    int dst_i = 0;
+    int src_i = 0;
+    for (; src_i + 32 <= length; src_i += 32) {
+        __m256i x = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(src + src_i));
+        bool all_valid;
+        __m256i y = atgcnChunk256<GAP>(x, all_valid);
+        if (all_valid) {
+            _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(dst + dst_i), y);
+            dst_i += 32;
+        } else if (GAP) {
+            dst_i += toAtgcnAndGapScalar(dst + dst_i,
+                                         src + src_i, 32);
+        } else {
+            dst_i += toAtgcnScalar(dst + dst_i,
+                                   src + src_i, 32);
+        }
+    }
+    if (GAP) {
+        dst_i += toAtgcnAndGapScalar(dst + dst_i, src + src_i,
+                                     length - src_i);
+    } else {
+        dst_i += toAtgcnScalar(dst + dst_i, src + src_i,
+                               length - src_i);
+    }
+    return dst_i;
+}
+
+#if defined(_MSC_VER)
+
+static bool hasSse41() {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+}
+
+static bool hasAvx2() {
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+    // OS saves YMM registers
+    if ((_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+#else
+
+static bool hasSse41() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+}
+
+static bool hasAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+#endif // NPGE_X86_SIMD
+
+static const StringKernels SCALAR_KERNELS = {
+    "scalar",
+    complementScalar,
+    toAtgcnScalar,
+    toAtgcnAndGapScalar,
+};
+
+#ifdef NPGE_X86_SIMD
+
+static const StringKernels SSE41_KERNELS = {
+    "sse4.1",
+    complementSse41,
+    toAtgcnSse41<false>,
+    toAtgcnSse41<true>,
+};
+
+static const StringKernels AVX2_KERNELS = {
+    "avx2",
+    complementAvx2,
+    toAtgcnAvx2<false>,
+    toAtgcnAvx2<true>,
+};
+
+#endif
+
+static const StringKernels* bestKernels() {
+#ifdef NPGE_X86_SIMD
+    if (hasAvx2()) {
+        return &AVX2_KERNELS;
+    }
+    if (hasSse41()) {
+        return &SSE41_KERNELS;
+    }
+#endif
+    return &SCALAR_KERNELS;
+}
+
+static const StringKernels* kernels_ = bestKernels();
+
+int complement(char* dst, const char* src, int length) {
+    return kernels_->complement(dst, src, length);
+}
+
+int toAtgcn(char* dst, const char* src, int length) {
+    return kernels_->toAtgcn(dst, src, length);
+}
+
+int toAtgcnAndGap(char* dst, const char* src, int length) {
+    return kernels_->toAtgcnAndGap(dst, src, length);
+}
+
+const char* stringKernels() {
+    return kernels_->name;
+}
+
+Strings supportedStringKernels() {
+    Strings result;
+    result.push_back(SCALAR_KERNELS.name);
+#ifdef NPGE_X86_SIMD
+    if (hasSse41()) {
+        result.push_back(SSE41_KERNELS.name);
+    }
+    if (hasAvx2()) {
+        result.push_back(AVX2_KERNELS.name);
+    }
+#endif
+    return result;
+}
+
+bool setStringKernels(const std::string& name) {
+    Strings supported = supportedStringKernels();
+    bool found = false;
+    for (int i = 0; i < supported.size(); i++) {
+        found |= (supported[i] == name);
+    }
+    if (!found) {
+        return false;
+    }
+    if (name == SCALAR_KERNELS.name) {
+        kernels_ = &SCALAR_KERNELS;
+    }
+#ifdef NPGE_X86_SIMD
+    if (name == SSE41_KERNELS.name) {
+        kernels_ = &SSE41_KERNELS;
+    }
+    if (name == AVX2_KERNELS.name) {
+        kernels_ = &AVX2_KERNELS;
+    }
+#endif
+    return true;
+}
+
+}
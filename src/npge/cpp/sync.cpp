@@ -0,0 +1,113 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#ifndef NPGE_NO_THREADS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+#endif
+
+#include "sync.hpp"
+
+namespace lnpge {
+
+#ifndef NPGE_NO_THREADS
+
+#ifdef _WIN32
+static long exchange(volatile long* target, long value) {
+    return InterlockedExchange(target, value);
+}
+
+static long add(volatile long* target, long value) {
+    return InterlockedExchangeAdd(target, value) + value;
+}
+
+static void yield() {
+    Sleep(0);
+}
+#else
+static long exchange(volatile long* target, long value) {
+    // full barrier, __sync_lock_test_and_set is acquire only
+    __sync_synchronize();
+    return __sync_lock_test_and_set(target, value);
+}
+
+static long add(volatile long* target, long value) {
+    return __sync_add_and_fetch(target, value);
+}
+
+static void yield() {
+    sched_yield();
+}
+#endif
+
+void SpinLock::lock() {
+    while (exchange(&locked_, 1) != 0) {
+        while (locked_ != 0) {
+            yield();
+        }
+    }
+}
+
+void SpinLock::unlock() {
+    exchange(&locked_, 0);
+}
+
+long AtomicCounter::load() const {
+    return add(const_cast<volatile long*>(&value_), 0);
+}
+
+void AtomicCounter::store(long value) {
+    exchange(&value_, value);
+}
+
+long AtomicCounter::increment() {
+    return add(&value_, 1);
+}
+
+long AtomicCounter::decrement() {
+    return add(&value_, -1);
+}
+
+#else
+
+void SpinLock::lock() {
+}
+
+void SpinLock::unlock() {
+}
+
+long AtomicCounter::load() const {
+    return value_;
+}
+
+void AtomicCounter::store(long value) {
+    value_ = value;
+}
+
+long AtomicCounter::increment() {
+    value_ += 1;
+    return value_;
+}
+
+long AtomicCounter::decrement() {
+    value_ -= 1;
+    return value_;
+}
+
+#endif
+
+SpinLockGuard::SpinLockGuard(SpinLock& lock):
+    lock_(lock) {
+    lock_.lock();
+}
+
+SpinLockGuard::~SpinLockGuard() {
+    lock_.unlock();
+}
+
+}
@@ -0,0 +1,69 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#ifndef NPGE_SYNC_HPP_
+#define NPGE_SYNC_HPP_
+
+namespace lnpge {
+
+// Primitives guarding global state of the module, which is
+// shared by all threads and Lua states of the process.
+// They are aggregates, so static variables are initialized
+// before any code runs (NPGE_SPIN_LOCK_INIT, NPGE_ATOMIC_INIT).
+// If NPGE_NO_THREADS is defined, they do not synchronize.
+
+// Lock for short critical sections, waiting threads yield.
+struct SpinLock {
+    volatile long locked_;
+
+    void lock();
+
+    void unlock();
+};
+
+#define NPGE_SPIN_LOCK_INIT {0}
+
+// locks the lock for the lifetime of the guard
+class SpinLockGuard {
+public:
+    explicit SpinLockGuard(SpinLock& lock);
+
+    ~SpinLockGuard();
+
+private:
+    SpinLock& lock_;
+
+    SpinLockGuard(const SpinLockGuard&);
+    void operator=(const SpinLockGuard&);
+};
+
+struct AtomicCounter {
+    volatile long value_;
+
+    long load() const;
+
+    void store(long value);
+
+    // return the new value
+    long increment();
+
+    long decrement();
+};
+
+#define NPGE_ATOMIC_INIT(value) {value}
+
+// storage class of variables with copy per thread,
+// only for types without constructors
+#if defined(NPGE_NO_THREADS)
+#define NPGE_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define NPGE_THREAD_LOCAL __declspec(thread)
+#else
+#define NPGE_THREAD_LOCAL __thread
+#endif
+
+}
+
+#endif
@@ -0,0 +1,330 @@
+/* lua-npge, Nucleotide PanGenome explorer (Lua module)
+ * Copyright (C) 2014-2016 Boris Nagaev
+ * See the LICENSE file for terms of use.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifndef NPGE_NO_THREADS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+#include "npge.hpp"
+#include "sync.hpp"
+
+namespace lnpge {
+
+ParallelTask::~ParallelTask() {
+}
+
+struct ParallelFor {
+    ParallelTask* task_;
+    int n_;
+    AtomicCounter next_;
+    SpinLock lock_;
+    bool failed_;
+    std::string error_;
+
+    ParallelFor(ParallelTask& task, int n):
+        task_(&task), n_(n), next_(), lock_(),
+        failed_(false) {
+        // next_ and lock_ are zeroed by value-initialization
+    }
+
+    void fail(const std::string& message) {
+        SpinLockGuard lock(lock_);
+        if (!failed_) {
+            failed_ = true;
+            error_ = message;
+        }
+    }
+
+    bool failed() {
+        SpinLockGuard lock(lock_);
+        return failed_;
+    }
+
+    void work() {
+        while (true) {
+            int index = next_.increment() - 1;
+            if (index >= n_ || failed()) {
+                break;
+            }
+            try {
+                task_->run(index);
+            } catch (std::exception& e) {
+                fail(e.what());
+            } catch (...) {
+                fail("Unknown exception");
+            }
+        }
+    }
+};
+
+#ifndef NPGE_NO_THREADS
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+
+static DWORD WINAPI threadMain(LPVOID arg);
+
+static bool startThread(Thread& thread) {
+    thread = CreateThread(0, 0, threadMain, 0, 0, 0);
+    return thread != 0;
+}
+
+static void joinThread(Thread& thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static void initMutex(Mutex& mutex) {
+    InitializeCriticalSection(&mutex);
+}
+
+static void lock(Mutex& mutex) {
+    EnterCriticalSection(&mutex);
+}
+
+static void unlock(Mutex& mutex) {
+    LeaveCriticalSection(&mutex);
+}
+
+static void initCondition(Condition& condition) {
+    InitializeConditionVariable(&condition);
+}
+
+static void wait(Condition& condition, Mutex& mutex) {
+    SleepConditionVariableCS(&condition, &mutex, INFINITE);
+}
+
+static void notifyAll(Condition& condition) {
+    WakeAllConditionVariable(&condition);
+}
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+
+extern "C" {
+static void* threadMain(void*);
+}
+
+static bool startThread(Thread& thread) {
+    return pthread_create(&thread, 0, threadMain, 0) == 0;
+}
+
+static void joinThread(Thread& thread) {
+    pthread_join(thread, 0);
+}
+
+static void initMutex(Mutex& mutex) {
+    pthread_mutex_init(&mutex, 0);
+}
+
+static void lock(Mutex& mutex) {
+    pthread_mutex_lock(&mutex);
+}
+
+static void unlock(Mutex& mutex) {
+    pthread_mutex_unlock(&mutex);
+}
+
+static void initCondition(Condition& condition) {
+    pthread_cond_init(&condition, 0);
+}
+
+static void wait(Condition& condition, Mutex& mutex) {
+    pthread_cond_wait(&condition, &mutex);
+}
+
+static void notifyAll(Condition& condition) {
+    pthread_cond_broadcast(&condition);
+}
+#endif
+
+// Threads of the pool wait for jobs between calls of
+// parallelFor, so they are started once per process.
+// One job runs at a time, concurrent calls of parallelFor
+// (from other Lua states) run in the calling thread.
+struct ThreadPool {
+    Mutex mutex_;
+    Condition wake_; // new job or stop
+    Condition done_; // running_ became 0
+    std::vector<Thread> threads_;
+    ParallelFor* job_;
+    int generation_; // incremented for each job
+    int wanted_; // threads still to join the job
+    int running_; // threads working on the job
+    bool busy_;
+    bool stop_;
+    int users_;
+
+    ThreadPool():
+        job_(0), generation_(0), wanted_(0), running_(0),
+        busy_(false), stop_(false), users_(0) {
+        initMutex(mutex_);
+        initCondition(wake_);
+        initCondition(done_);
+    }
+
+    void threadMain() {
+        lock(mutex_);
+        // new thread joins the job it was started for
+        int seen = -1;
+        while (true) {
+            while (!stop_ && generation_ == seen) {
+                wait(wake_, mutex_);
+            }
+            if (stop_) {
+                break;
+            }
+            seen = generation_;
+            if (wanted_ > 0) {
+                wanted_ -= 1;
+                running_ += 1;
+                ParallelFor* job = job_;
+                unlock(mutex_);
+                job->work();
+                lock(mutex_);
+                running_ -= 1;
+                if (running_ == 0) {
+                    notifyAll(done_);
+                }
+            }
+        }
+        unlock(mutex_);
+    }
+
+    // returns false if the pool is used by other thread
+    bool run(ParallelFor& job, int helpers) {
+        lock(mutex_);
+        if (busy_) {
+            unlock(mutex_);
+            return false;
+        }
+        busy_ = true;
+        while (threads_.size() < helpers) {
+            Thread thread;
+            if (!startThread(thread)) {
+                // continue with threads already started
+                break;
+            }
+            threads_.push_back(thread);
+        }
+        job_ = &job;
+        wanted_ = std::min(helpers, int(threads_.size()));
+        generation_ += 1;
+        notifyAll(wake_);
+        unlock(mutex_);
+        job.work();
+        lock(mutex_);
+        // all indexes are taken, late threads are not needed
+        wanted_ = 0;
+        while (running_ > 0) {
+            wait(done_, mutex_);
+        }
+        job_ = 0;
+        busy_ = false;
+        unlock(mutex_);
+        return true;
+    }
+
+    void stop() {
+        lock(mutex_);
+        stop_ = true;
+        notifyAll(wake_);
+        unlock(mutex_);
+        for (int i = 0; i < threads_.size(); i++) {
+            joinThread(threads_[i]);
+        }
+        threads_.clear();
+        stop_ = false;
+    }
+};
+
+static ThreadPool thread_pool_;
+
+static ThreadPool& threadPool() {
+    return thread_pool_;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI threadMain(LPVOID) {
+    threadPool().threadMain();
+    return 0;
+}
+#else
+extern "C" {
+static void* threadMain(void*) {
+    threadPool().threadMain();
+    return 0;
+}
+}
+#endif
+
+void retainThreads() {
+    ThreadPool& pool = threadPool();
+    lock(pool.mutex_);
+    pool.users_ += 1;
+    unlock(pool.mutex_);
+}
+
+void releaseThreads() {
+    ThreadPool& pool = threadPool();
+    lock(pool.mutex_);
+    pool.users_ -= 1;
+    bool last = (pool.users_ == 0);
+    unlock(pool.mutex_);
+    if (last) {
+        pool.stop();
+    }
+}
+
+#else
+
+void retainThreads() {
+}
+
+void releaseThreads() {
+}
+
+#endif
+
+void parallelFor(ParallelTask& task, int n, int workers) {
+    ParallelFor job(task, n);
+#ifndef NPGE_NO_THREADS
+    int helpers = std::min(workers, n) - 1;
+    if (helpers <= 0 || !threadPool().run(job, helpers)) {
+        job.work();
+    }
+#else
+    job.work();
+#endif
+    if (job.failed_) {
+        throw std::logic_error(job.error_);
+    }
+}
+
+void largestFirst(Ints& order,
+                  const std::vector<double>& costs) {
+    int n = costs.size();
+    std::vector<std::pair<double, int> > pairs(n);
+    for (int i = 0; i < n; i++) {
+        pairs[i] = std::make_pair(-costs[i], i);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = pairs[i].second;
+    }
+}
+
+}
@@ -0,0 +1,5 @@
+-- lua-npge, Nucleotide PanGenome explorer (Lua module)
+-- Copyright (C) 2014-2016 Boris Nagaev
+-- See the LICENSE file for terms of use.
+
+return require 'npge.cpp'.model.BlockSetBuilder
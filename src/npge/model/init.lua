@@ -7,4 +7,5 @@ return {
     Fragment = require 'npge.model.Fragment',
     Block = require 'npge.model.Block',
     BlockSet = require 'npge.model.BlockSet',
+    BlockSetBuilder = require 'npge.model.BlockSetBuilder',
 }
@@ -2,12 +2,50 @@
 -- Copyright (C) 2014-2016 Boris Nagaev
 -- See the LICENSE file for terms of use.
 
+-- longest processing time first: the most costly item
+-- goes to the group with minimum total cost
+local function mapByCost(groups, items, cost)
+    local ngroups = #groups
+    local costs = {}
+    local order = {}
+    for i, item in ipairs(items) do
+        costs[i] = cost(item)
+        order[i] = i
+    end
+    table.sort(order, function(a, b)
+        if costs[a] ~= costs[b] then
+            return costs[a] > costs[b]
+        end
+        return a < b
+    end)
+    local totals = {}
+    for igroup = 1, ngroups do
+        totals[igroup] = 0
+    end
+    for _, i in ipairs(order) do
+        local best = 1
+        for igroup = 2, ngroups do
+            if totals[igroup] < totals[best] then
+                best = igroup
+            end
+        end
+        totals[best] = totals[best] + costs[i]
+        table.insert(groups[best], items[i])
+    end
+    return groups
+end
+
 -- map items to ngroups groups of almost equal size
-return function(ngroups, items)
+-- if function cost is provided, groups have almost equal
+-- sums of cost(item) instead
+return function(ngroups, items, cost)
     local groups = {}
     for _ = 1, ngroups do
         table.insert(groups, {})
     end
+    if cost then
+        return mapByCost(groups, items, cost)
+    end
     math.randomseed(os.time())
     for i, item in ipairs(items) do
         local igroup = ((i - 1) % ngroups) + 1
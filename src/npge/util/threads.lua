@@ -2,48 +2,28 @@
 -- Copyright (C) 2014-2016 Boris Nagaev
 -- See the LICENSE file for terms of use.
 
--- see https://github.com/moteus/lua-llthreads2
--- WARNING target executable must be linked against pthread
--- Otherwise memory errors occur
--- LD_PRELOAD=/lib/x86_64-linux-gnu/libpthread.so.0 lua ...
+-- Codes are run in Lua states of workers, which are
+-- created once with npge loaded (see runWorkers in npge.cpp).
+-- Config is loaded to a worker only when it was changed.
 
-local workerCode = [[
-local config = require 'npge.config'
-config:load(%q)
-return xpcall(function()
-    %s
-end, function(message)
-    return message .. '\n' .. debug.traceback()
-end)
-]]
-
-local spawnWorkers = function(generator, workers, conf)
-    local llthreads2 = require "llthreads2"
-    local threads = {}
-    for _, code in ipairs(generator(workers)) do
-        local code1 = workerCode:format(conf, code)
-        local thread = llthreads2.new(code1)
-        thread:start()
-        table.insert(threads, thread)
-    end
-    return threads
-end
-
-local collectResults = function(collector, threads)
-    local errors = {}
+local runHere = function(codes, cleanup)
+    local loadstring = require 'npge.util.loadstring'
     local results = {}
-    for _, thread in ipairs(threads) do
-        local _, status, result = thread:join()
-        if status then
-            -- if result is nil, do table.insert does nothing
+    for _, code in ipairs(codes) do
+        -- nils are skipped like in workers,
+        -- only first result of the code is used
+        local ok, result = pcall(loadstring(code))
+        if not ok then
+            if cleanup then
+                cleanup(results)
+            end
+            error(result)
+        end
+        if result ~= nil then
             table.insert(results, result)
-        else
-            table.insert(errors, result)
         end
     end
-    assert(#errors == 0, "Errors in threads: " ..
-        table.concat(errors, "\n"))
-    return collector(results)
+    return results
 end
 
 -- run an action with threads.
@@ -53,17 +33,27 @@ end
 -- - collector is a function, which gets an array of results
 --   threads one after another, and returns final result,
 --   which is returned from this function.
-return function(generator, collector)
+-- - cleanup (optional) is a function, which gets an array of
+--   results of codes, which succeeded, if some code failed.
+--   It is called before the error is raised.
+return function(generator, collector, cleanup)
     local config = require 'npge.config'
     local workers = config.util.WORKERS
-    local has_llthreads2 = pcall(require, "llthreads2")
-    if workers == 1 or not has_llthreads2 then
-        local loadstring = require 'npge.util.loadstring'
-        local code = generator(1)[1]
-        local result = loadstring(code)()
-        return collector({result})
+    if workers == 1 then
+        return collector(runHere(generator(1), cleanup))
+    end
+    local codes = generator(workers)
+    local runWorkers = require 'npge.cpp'.func.runWorkers
+    local results, errors = runWorkers(codes, config:save(),
+        workers)
+    if not results then
+        -- workers are used by other thread (nested call)
+        return collector(runHere(codes, cleanup))
+    end
+    if #errors ~= 0 and cleanup then
+        cleanup(results)
     end
-    local conf = config:save()
-    local threads = spawnWorkers(generator, workers, conf)
-    return collectResults(collector, threads)
+    assert(#errors == 0, "Errors in threads: " ..
+        table.concat(errors, "\n"))
+    return collector(results)
 end